@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <ctime>
+#include <cerrno>
+
+#include "arena_pool.h"
+#include "err.h"
+
+namespace {
+    long parse_number(const std::string &value, long min, long max, const char *key) {
+        char *end;
+        errno = 0;
+        long n = strtol(value.c_str(), &end, 10);
+        if (errno != 0 || *end != '\0' || value.empty() || n < min || n > max)
+            fatal("invalid value of %s in arena config: %s", key, value.c_str());
+        return n;
+    }
+
+    void parse_arena(std::istringstream &line, server_params_t &p) {
+        std::string token;
+        while (line >> token) {
+            auto eq = token.find('=');
+            if (eq == std::string::npos)
+                fatal("invalid arena parameter: %s", token.c_str());
+            std::string key = token.substr(0, eq);
+            std::string value = token.substr(eq + 1);
+
+            if (key == "port")
+                p.port = parse_number(value, 1, UINT16_MAX, "port");
+            else if (key == "seed")
+                p.generator_seed = parse_number(value, 0, UINT32_MAX, "seed");
+            else if (key == "turning_speed")
+                p.turning_speed = parse_number(value, 1, 90, "turning_speed");
+            else if (key == "rounds_per_second")
+                p.rounds_per_second = parse_number(value, 1, 250, "rounds_per_second");
+            else if (key == "width")
+                p.width = parse_number(value, MIN_SCREEN_SIZE, MAX_SCREEN_SIZE, "width");
+            else if (key == "height")
+                p.height = parse_number(value, MIN_SCREEN_SIZE, MAX_SCREEN_SIZE, "height");
+            else if (key == "max_catch_up_ticks")
+                p.max_catch_up_ticks = parse_number(value, 0, MAX_CATCH_UP_TICKS,
+                                                    "max_catch_up_ticks");
+            else if (key == "max_clients")
+                p.max_clients = parse_number(value, 1, MAX_CLIENTS, "max_clients");
+            else if (key == "snapshot_interval")
+                p.snapshot_interval = parse_number(value, 0, MAX_SNAPSHOT_INTERVAL,
+                                                   "snapshot_interval");
+            else if (key == "journal")
+                p.journal_path = value;
+            else
+                fatal("unknown arena parameter: %s", key.c_str());
+        }
+    }
+}
+
+arena_config_t load_arena_config(const std::string &path, const server_params_t &defaults) {
+    std::ifstream file(path);
+    if (!file)
+        fatal("cannot open arena config %s", path.c_str());
+
+    arena_config_t config{std::thread::hardware_concurrency(), {}};
+    std::string text;
+    int next_port = defaults.port;
+    while (std::getline(file, text)) {
+        std::istringstream line(text);
+        std::string directive;
+        if (!(line >> directive) || directive[0] == '#')
+            continue;
+
+        if (directive == "workers") {
+            std::string value;
+            line >> value;
+            config.workers = parse_number(value, 1, MAX_WORKERS, "workers");
+        }
+        else if (directive == "arena") {
+            server_params_t p = defaults;
+            p.port = next_port;
+            // Every arena gets its own generator, seeded differently unless set.
+            p.generator_seed = defaults.generator_seed + config.arenas.size();
+            p.journal_path.clear();
+            parse_arena(line, p);
+            // Arenas without own journal share the default path suffixed with their ports.
+            if (p.journal_path.empty() && !defaults.journal_path.empty())
+                p.journal_path = defaults.journal_path + "." + std::to_string(p.port);
+            // Multi-arena mode is driven by worker poll loops only.
+            p.use_io_uring = false;
+            p.sender_threads = 0;
+            p.upstream.clear();
+            config.arenas.push_back(p);
+            next_port = p.port + 1;
+        }
+        else {
+            fatal("unknown directive in arena config: %s", directive.c_str());
+        }
+    }
+
+    if (config.arenas.empty())
+        fatal("arena config %s defines no arenas", path.c_str());
+    if (config.workers == 0)
+        config.workers = 1;
+
+    return config;
+}
+
+ArenaPool::ArenaPool(const arena_config_t &config) : workers(config.workers) {
+    for (auto p : config.arenas)
+        arenas.push_back(std::make_unique<Server>(p));
+
+    // There is no point in running workers without arenas.
+    workers = std::min(workers, arenas.size());
+}
+
+void ArenaPool::export_metrics(MetricsExporter &exporter) const {
+    for (const auto &arena : arenas)
+        exporter.add_server(arena->get_port(), arena->get_metrics());
+}
+
+[[noreturn]] void ArenaPool::run() {
+    std::vector<std::thread> threads;
+    unsigned int cores = std::max(1u, std::thread::hardware_concurrency());
+
+    for (size_t worker = 0; worker < workers; ++worker) {
+        threads.emplace_back(&ArenaPool::run_worker, this, worker);
+
+        // Pins worker to a single core.
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker % cores, &cpus);
+        pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpus), &cpus);
+    }
+
+    for (auto &thread : threads)
+        thread.join();
+
+    exit(EXIT_FAILURE);
+}
+
+[[noreturn]] void ArenaPool::run_worker(size_t worker) {
+    // Arena i is owned by worker (i mod workers).
+    std::vector<Server *> owned;
+    for (size_t i = worker; i < arenas.size(); i += workers)
+        owned.push_back(arenas[i].get());
+
+    std::vector<struct pollfd> poll_fds(2 * owned.size());
+    for (size_t i = 0; i < owned.size(); ++i) {
+        owned[i]->start();
+        poll_fds[2 * i] = {owned[i]->get_socket_fd(), POLLIN, 0};
+        poll_fds[2 * i + 1] = {owned[i]->get_timer_fd(), POLLIN, 0};
+    }
+
+    time_t next_report = time(nullptr) + ARENA_REPORT_INTERVAL;
+    while (true) {
+        for (size_t i = 0; i < owned.size(); ++i) {
+            poll_fds[2 * i].events = owned[i]->get_socket_events();
+            poll_fds[2 * i].revents = 0;
+            poll_fds[2 * i + 1].revents = 0;
+        }
+
+        int ret = poll(poll_fds.data(), poll_fds.size(), 1000);
+        if (ret == -1) {
+            if (errno == EINTR)
+                fprintf(stderr, "Interrupted system call\n");
+            else
+                syserr("poll");
+
+            continue;
+        }
+
+        for (size_t i = 0; i < owned.size(); ++i) {
+            if (poll_fds[2 * i].revents || poll_fds[2 * i + 1].revents)
+                owned[i]->process_events(poll_fds[2 * i].revents, poll_fds[2 * i + 1].revents);
+        }
+
+        if (time(nullptr) >= next_report) {
+            report(worker);
+            next_report += ARENA_REPORT_INTERVAL;
+        }
+    }
+}
+
+void ArenaPool::report(size_t worker) {
+    for (size_t i = worker; i < arenas.size(); i += workers) {
+        const tick_stats_t &stats = arenas[i]->get_tick_stats();
+        const gso_stats_t &gso = arenas[i]->get_gso_stats();
+        const tick_timing_stats_t &timing = arenas[i]->get_tick_timing_stats();
+        double average = stats.ticks > 0 ? double(stats.total_ns) / stats.ticks / 1000.0 : 0.0;
+        fprintf(stderr, "arena %zu (port %d, worker %zu): %lu ticks, avg %.1f us, max %.1f us, "
+                "outbound %zu descriptors, %zu payload bytes, "
+                "GSO saved %lu sends (%lu bytes)\n",
+                i, arenas[i]->get_port(), worker, stats.ticks, average,
+                double(stats.max_ns) / 1000.0, arenas[i]->get_queued_descriptors(),
+                arenas[i]->get_payload_bytes(), gso.saved_calls, gso.bytes);
+
+        // Buckets are printed as counts below 10 us, 100 us, ..., 100 ms and above.
+        std::string lateness, excess;
+        for (size_t b = 0; b < TICK_HISTOGRAM_BUCKETS; ++b) {
+            lateness += " " + std::to_string(timing.lateness[b]);
+            excess += " " + std::to_string(timing.overrun_excess[b]);
+        }
+        fprintf(stderr, "arena %zu: %lu missed, %lu dropped, %lu overruns, lateness [%s ], "
+                "overrun excess [%s ]\n", i, timing.missed_ticks, timing.dropped_ticks,
+                timing.overruns, lateness.c_str(), excess.c_str());
+    }
+}
@@ -0,0 +1,63 @@
+#ifndef SCREEN_WORMS_ARENA_POOL_H
+#define SCREEN_WORMS_ARENA_POOL_H
+
+#include <memory>
+#include <vector>
+#include <string>
+
+#include "server.h"
+#include "metrics.h"
+
+#define MAX_WORKERS             256
+#define ARENA_REPORT_INTERVAL   10
+
+struct arena_config_t {
+    size_t workers;
+    std::vector<server_params_t> arenas;
+};
+
+/*
+ * Reads multi-arena configuration from file at [path]. Parameters not given for an
+ * arena are taken from [defaults]; an arena without a port listens on the port
+ * following the previous arena's one. Exits the program if the file is invalid.
+ *
+ * File consists of lines (empty lines and lines starting with '#' are skipped):
+ *   workers n
+ *   arena [port=n] [seed=n] [turning_speed=n] [rounds_per_second=n] [width=n] [height=n]
+ *         [max_catch_up_ticks=n] [max_clients=n] [journal=file]
+ * Arena without a journal records to the default journal path suffixed with its port,
+ * if there is one.
+ */
+arena_config_t load_arena_config(const std::string &path, const server_params_t &defaults);
+
+/*
+ * Runs many independent arenas, each being a separate [Server] with its own socket,
+ * game state and random generator. Arenas are pinned to worker threads; every worker
+ * runs its own poll loop over sockets and round timers of its arenas only, so arenas
+ * never share state and no locking is needed.
+ */
+class ArenaPool {
+public:
+    explicit ArenaPool(const arena_config_t &config);
+
+    /*
+     * Registers metrics of all arenas in [exporter].
+     */
+    void export_metrics(MetricsExporter &exporter) const;
+
+    [[noreturn]] void run();
+
+private:
+    [[noreturn]] void run_worker(size_t worker);
+
+    /*
+     * Prints tick timings of arenas owned by given worker to stderr.
+     */
+    void report(size_t worker);
+
+private:
+    std::vector<std::unique_ptr<Server>> arenas;
+    size_t workers;
+};
+
+#endif //SCREEN_WORMS_ARENA_POOL_H
@@ -0,0 +1,339 @@
+#include "board_snapshot.h"
+#include "crc32.h"
+#include "varint.h"
+
+namespace {
+    // Offsets of fields of a snapshot part patched once they are known.
+    constexpr size_t PARTS_OFFSET = sizeof(game_id_t) + sizeof(uint8_t) + 2 * sizeof(event_no_t) +
+                                    sizeof(uint16_t);
+    constexpr size_t ELIMINATED_OFFSET = PARTS_OFFSET + sizeof(uint16_t);
+    constexpr size_t HEADER_LENGTH = ELIMINATED_OFFSET + sizeof(uint16_t);
+
+    uint16_t read_number16(const char *data) {
+        uint16_t n;
+        memcpy(&n, data, sizeof(n));
+        return be16toh(n);
+    }
+
+    uint32_t read_number32(const char *data) {
+        uint32_t n;
+        memcpy(&n, data, sizeof(n));
+        return be32toh(n);
+    }
+
+    void write_number16(char *data, uint16_t n) {
+        n = htobe16(n);
+        memcpy(data, &n, sizeof(n));
+    }
+}
+
+SnapshotBuilder::SnapshotBuilder() : game_id(0), game_started(false), width(0), height(0),
+        followed(0), header_events(0), last_watermark(0), scan_position(0), run_start(0),
+        run_length(0), run_owner(0), part_owner(0), part_eliminated(0), part_has_runs(false),
+        snapshots_built(0) {}
+
+void SnapshotBuilder::reserve(coordinate_t max_width, coordinate_t max_height) {
+    if (size_t(max_width) * max_height > owners.size())
+        owners.resize(size_t(max_width) * max_height, 0);
+}
+
+void SnapshotBuilder::reset(game_id_t new_game_id) {
+    for (uint32_t index : eaten)
+        owners[index] = 0;
+    eaten.clear();
+    row_pixels.assign(height, 0);
+    eliminated.clear();
+    followed = 0;
+    header_events = 0;
+    last_watermark = 0;
+    building.reset();
+    snapshot.reset();
+    game_id = new_game_id;
+    game_started = true;
+}
+
+void SnapshotBuilder::follow(const char *event) {
+    event_type_t type = event[sizeof(event_len_t) + sizeof(event_no_t)];
+    const char *data = event + sizeof(event_len_t) + sizeof(event_no_t) + sizeof(event_type_t);
+
+    switch (type) {
+        case NEW_GAME:
+        case WIDE_NEW_GAME: {
+            coordinate_t maxx = read_number32(data);
+            coordinate_t maxy = read_number32(data + sizeof(coordinate_t));
+            // Board of a relayed game comes from upstream; one larger than any server
+            // may have is left without snapshots, as if it had no pixels.
+            if (maxx > MAX_SCREEN_SIZE || maxy > MAX_SCREEN_SIZE)
+                maxx = maxy = 0;
+            if (maxx != width || maxy != height) {
+                for (uint32_t index : eaten)
+                    owners[index] = 0;
+                eaten.clear();
+                width = maxx;
+                height = maxy;
+                reserve(width, height);
+                row_pixels.assign(height, 0);
+            }
+            break;
+        }
+        case PIXEL:
+        case WIDE_PIXEL: {
+            size_t number_len = type == PIXEL ? sizeof(legacy_player_number_t) :
+                                                sizeof(player_number_t);
+            player_number_t number = type == PIXEL ? uint8_t(data[0]) : read_number16(data);
+            coordinate_t x = read_number32(data + number_len);
+            coordinate_t y = read_number32(data + number_len + sizeof(coordinate_t));
+            if (x >= width || y >= height)
+                break;
+
+            uint32_t index = y * width + x;
+            if (owners[index] == 0) {
+                owners[index] = number + 1;
+                eaten.push_back(index);
+                ++row_pixels[y];
+            }
+            break;
+        }
+        case PLAYER_ELIMINATED:
+            eliminated.push_back(uint8_t(data[0]));
+            break;
+        case WIDE_PLAYER_ELIMINATED:
+            eliminated.push_back(read_number16(data));
+            break;
+        default:
+            break;
+    }
+
+    // Events announcing the game come first.
+    if ((type == NEW_GAME || type == WIDE_NEW_GAME || type == PLAYER_NAMES) &&
+        followed == header_events) {
+        ++header_events;
+    }
+}
+
+bool SnapshotBuilder::update(game_id_t new_game_id, const EventCollection &events,
+                             size_t interval) {
+    if (!game_started || new_game_id != game_id || events.get_size() < followed)
+        reset(new_game_id);
+    for (; followed < events.get_size(); ++followed)
+        follow(events.get_event_data(followed));
+
+    if (building == nullptr && interval > 0 && width > 0 &&
+        events.get_size() >= std::max<size_t>(last_watermark, header_events) + interval) {
+        start(events.get_size());
+    }
+
+    return building != nullptr && scan(SNAPSHOT_PIXELS_PER_TICK) && finish();
+}
+
+void SnapshotBuilder::start(event_no_t watermark) {
+    last_watermark = watermark;
+    building = std::make_unique<BoardSnapshot>(game_id, watermark, header_events);
+    scan_position = 0;
+    run_start = 0;
+    run_length = 0;
+    run_owner = 0;
+    begin_part();
+
+    // All eliminations followed so far happened before the watermark.
+    for (player_number_t number : eliminated) {
+        char encoded[MAX_VARINT_LENGTH];
+        size_t len = put_varint(encoded, number);
+        if (len + sizeof(crc32_t) > part.get_space_left()) {
+            flush_part();
+            begin_part();
+        }
+        part.insert_bytes(encoded, len);
+        ++part_eliminated;
+    }
+}
+
+void SnapshotBuilder::begin_part() {
+    part.clear();
+    part.insert_number(game_id);
+    part.insert_number(uint8_t(SNAPSHOT_MARKER));
+    part.insert_number(building->watermark);
+    part.insert_number(building->header_events);
+    part.insert_number(uint16_t(building->parts.size()));
+    // Number of parts and of eliminated players are written once known.
+    part.insert_number(uint16_t(0));
+    part.insert_number(uint16_t(0));
+    part_owner = 0;
+    part_eliminated = 0;
+    part_has_runs = false;
+}
+
+void SnapshotBuilder::flush_part() {
+    write_number16(part.get_data() + ELIMINATED_OFFSET, part_eliminated);
+    building->parts.push_back(part);
+}
+
+void SnapshotBuilder::emit_run(uint32_t position, uint32_t length, uint16_t owner) {
+    // Part starts with its first eaten run.
+    if (owner == 0 && !part_has_runs)
+        return;
+
+    while (true) {
+        char encoded[3 * MAX_VARINT_LENGTH];
+        size_t len = 0;
+        if (!part_has_runs)
+            len += put_varint(encoded, position);
+        if (owner == 0) {
+            len += put_varint(encoded + len, length << 2 | SNAPSHOT_GAP);
+        }
+        else if (owner == part_owner) {
+            len += put_varint(encoded + len, length << 2 | SNAPSHOT_SAME_OWNER);
+        }
+        else {
+            len += put_varint(encoded + len, length << 2 | SNAPSHOT_NEW_OWNER);
+            len += put_varint(encoded + len, owner - 1);
+        }
+
+        if (len + sizeof(crc32_t) <= part.get_space_left()) {
+            part.insert_bytes(encoded, len);
+            part_has_runs = true;
+            if (owner != 0)
+                part_owner = owner;
+            return;
+        }
+
+        flush_part();
+        begin_part();
+        if (owner == 0)
+            return;
+    }
+}
+
+bool SnapshotBuilder::scan(size_t budget) {
+    uint32_t total = width * height;
+    size_t scanned = 0;
+    while (scan_position < total && scanned < budget &&
+           building->parts.size() < MAX_SNAPSHOT_PARTS) {
+        uint32_t row_end = (scan_position / width + 1) * width;
+        // Row with no eaten pixel extends the current gap at once.
+        if (row_pixels[scan_position / width] == 0) {
+            if (run_length > 0 && run_owner != 0) {
+                emit_run(run_start, run_length, run_owner);
+                run_length = 0;
+            }
+            if (run_length == 0) {
+                run_start = scan_position;
+                run_owner = 0;
+            }
+            run_length += row_end - scan_position;
+            scan_position = row_end;
+            ++scanned;
+            continue;
+        }
+
+        for (; scan_position < row_end; ++scan_position) {
+            uint16_t owner = owners[scan_position];
+            if (run_length > 0 && owner == run_owner) {
+                ++run_length;
+                continue;
+            }
+            if (run_length > 0)
+                emit_run(run_start, run_length, run_owner);
+            run_start = scan_position;
+            run_length = 1;
+            run_owner = owner;
+        }
+        scanned += width;
+    }
+
+    return scan_position == total || building->parts.size() >= MAX_SNAPSHOT_PARTS;
+}
+
+bool SnapshotBuilder::finish() {
+    // Pixels after the last eaten run are not eaten anyway.
+    if (run_length > 0 && run_owner != 0)
+        emit_run(run_start, run_length, run_owner);
+    if (part_has_runs || part_eliminated > 0 || building->parts.empty())
+        flush_part();
+
+    std::unique_ptr<BoardSnapshot> built = std::move(building);
+    if (scan_position < width * height || built->parts.size() > MAX_SNAPSHOT_PARTS)
+        return false;
+
+    for (Buffer &done : built->parts) {
+        write_number16(done.get_data() + PARTS_OFFSET, built->parts.size());
+        done.insert_number(compute_crc32(done.get_data(), done.get_length()));
+        built->bytes += done.get_length();
+    }
+
+    snapshot = std::move(built);
+    ++snapshots_built;
+    return true;
+}
+
+bool is_snapshot_part(const char *data, size_t len) {
+    return len > sizeof(game_id_t) && uint8_t(data[sizeof(game_id_t)]) == SNAPSHOT_MARKER;
+}
+
+bool verify_snapshot_part(const char *data, size_t len) {
+    if (len < HEADER_LENGTH + sizeof(crc32_t))
+        return false;
+
+    return compute_crc32(data, len - sizeof(crc32_t)) ==
+        read_number32(data + len - sizeof(crc32_t));
+}
+
+bool decode_snapshot_part(const char *data, size_t len, snapshot_part_t &part) {
+    size_t end = len - sizeof(crc32_t);
+    part.game_id = read_number32(data);
+    part.watermark = read_number32(data + sizeof(game_id_t) + sizeof(uint8_t));
+    part.header_events = read_number32(data + sizeof(game_id_t) + sizeof(uint8_t) +
+                                       sizeof(event_no_t));
+    part.part = read_number16(data + PARTS_OFFSET - sizeof(uint16_t));
+    part.parts = read_number16(data + PARTS_OFFSET);
+    part.eliminated.clear();
+    part.runs.clear();
+    if (part.part >= part.parts)
+        return false;
+
+    size_t position = HEADER_LENGTH;
+    for (uint16_t i = read_number16(data + ELIMINATED_OFFSET); i > 0; --i) {
+        uint32_t number;
+        if (!get_varint(data, end, position, number) || number > UINT16_MAX)
+            return false;
+        part.eliminated.push_back(number);
+    }
+
+    if (position == end)
+        return true;
+    uint32_t pixel;
+    if (!get_varint(data, end, position, pixel))
+        return false;
+
+    uint32_t owner = 0;
+    bool owner_known = false;
+    while (position < end) {
+        uint32_t token;
+        if (!get_varint(data, end, position, token))
+            return false;
+        uint32_t length = token >> 2;
+        switch (token & 3) {
+            case SNAPSHOT_GAP:
+                break;
+            case SNAPSHOT_SAME_OWNER:
+                if (!owner_known)
+                    return false;
+                part.runs.push_back({pixel, length, player_number_t(owner)});
+                break;
+            case SNAPSHOT_NEW_OWNER:
+                if (!get_varint(data, end, position, owner) || owner >= UINT16_MAX)
+                    return false;
+                owner_known = true;
+                part.runs.push_back({pixel, length, player_number_t(owner)});
+                break;
+            default:
+                return false;
+        }
+
+        if (length == 0 || uint64_t(pixel) + length > UINT32_MAX)
+            return false;
+        pixel += length;
+    }
+
+    return true;
+}
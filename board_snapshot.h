@@ -0,0 +1,226 @@
+#ifndef SCREEN_WORMS_BOARD_SNAPSHOT_H
+#define SCREEN_WORMS_BOARD_SNAPSHOT_H
+
+#include <memory>
+#include <vector>
+
+#include "buffer.h"
+#include "event.h"
+#include "event_collection.h"
+#include "server_types.h"
+
+// Byte following game id in snapshot datagrams; event datagrams never have it there.
+#define SNAPSHOT_MARKER             0xFF
+// Pixels of the board a snapshot being built advances by per tick.
+#define SNAPSHOT_PIXELS_PER_TICK    (1 << 18)
+#define MAX_SNAPSHOT_PARTS          UINT16_MAX
+// Largest number of events between snapshots that may be configured.
+#define MAX_SNAPSHOT_INTERVAL       (1 << 24)
+
+// Kinds of runs of pixels in snapshot parts.
+enum snapshot_run_kind {
+    SNAPSHOT_GAP,
+    SNAPSHOT_SAME_OWNER,
+    SNAPSHOT_NEW_OWNER
+};
+
+/*
+ * Image of the board of a game, sent to clients that set SNAPSHOT_FLAG instead of
+ * the events it stands for: those after the header events announcing the game up to
+ * the watermark. The image holds every pixel eaten by events before the watermark
+ * and possibly some eaten later, which the client gets again as events after it;
+ * eliminated players are exactly those eliminated before the watermark.
+ *
+ * A snapshot is sent in parts, each decodable on its own:
+ *
+ *   game_id (4) | SNAPSHOT_MARKER (1) | watermark (4) | header events (4) | part (2) |
+ *   parts (2) | eliminated count (2) | eliminated players (varints) |
+ *   [start position (varint) | runs] | crc32 (4)
+ *
+ * and the checksum covers everything before it. Positions count pixels row by row.
+ * Runs cover consecutive pixels from the start position; each is a varint holding
+ * run length shifted left by 2 and its kind: SNAPSHOT_GAP for pixels not eaten,
+ * SNAPSHOT_SAME_OWNER for pixels of the owner of the previous eaten run of the part
+ * and SNAPSHOT_NEW_OWNER followed by player number as varint. Pixels after the last
+ * run of the last part are not eaten.
+ */
+class BoardSnapshot {
+public:
+    BoardSnapshot(game_id_t game_id, event_no_t watermark, event_no_t header_events) :
+            game_id(game_id), watermark(watermark), header_events(header_events), bytes(0) {}
+
+    game_id_t get_game_id() const {
+        return game_id;
+    }
+
+    event_no_t get_watermark() const {
+        return watermark;
+    }
+
+    event_no_t get_header_events() const {
+        return header_events;
+    }
+
+    size_t get_part_count() const {
+        return parts.size();
+    }
+
+    const Buffer &get_part(size_t part) const {
+        return parts[part];
+    }
+
+    /*
+     * Total length of all parts.
+     */
+    size_t get_bytes() const {
+        return bytes;
+    }
+
+private:
+    friend class SnapshotBuilder;
+
+    game_id_t game_id;
+    event_no_t watermark;
+    event_no_t header_events;
+    std::vector<Buffer> parts;
+    size_t bytes;
+};
+
+/*
+ * Follows events of the current game and keeps owner of every eaten pixel. Once
+ * enough events were added since the last snapshot, it starts a new one and
+ * advances it by SNAPSHOT_PIXELS_PER_TICK pixels per call, skipping rows with no
+ * eaten pixel. The image of the board only grows and is cleared through the list
+ * of eaten pixels; it should be reserved before the first game, as allocating it
+ * for a big board takes longer than a tick. Games on boards wider or higher than
+ * MAX_SCREEN_SIZE are not followed.
+ */
+class SnapshotBuilder {
+public:
+    SnapshotBuilder();
+
+    /*
+     * Allocates the image for boards of up to [max_width] x [max_height] pixels.
+     */
+    void reserve(coordinate_t max_width, coordinate_t max_height);
+
+    /*
+     * Follows events of game [game_id] added since the previous call and advances
+     * the snapshot being built. A new snapshot is started once [interval] events
+     * were added after the watermark of the last one. Returns [true] if a snapshot
+     * was completed.
+     */
+    bool update(game_id_t game_id, const EventCollection &events, size_t interval);
+
+    /*
+     * Latest completed snapshot of the current game, or null.
+     */
+    const std::shared_ptr<const BoardSnapshot> &get_snapshot() const {
+        return snapshot;
+    }
+
+    uint64_t get_snapshots_built() const {
+        return snapshots_built;
+    }
+
+private:
+    void reset(game_id_t game_id);
+
+    void follow(const char *event);
+
+    void start(event_no_t watermark);
+
+    /*
+     * Scans pixels of the board within [budget]. Returns [true] when the whole
+     * board was scanned.
+     */
+    bool scan(size_t budget);
+
+    /*
+     * Appends run of [length] pixels of [owner], 0 for not eaten ones, starting at
+     * [position].
+     */
+    void emit_run(uint32_t position, uint32_t length, uint16_t owner);
+
+    void begin_part();
+
+    /*
+     * Moves the current part to the snapshot being built.
+     */
+    void flush_part();
+
+    /*
+     * Completes the snapshot being built. Returns [false] if it had too many parts
+     * and was dropped.
+     */
+    bool finish();
+
+private:
+    game_id_t game_id;
+    bool game_started;
+    coordinate_t width;
+    coordinate_t height;
+    // Player number plus one of every pixel of the board, 0 if not eaten.
+    std::vector<uint16_t> owners;
+    std::vector<uint32_t> row_pixels;
+    // Eaten pixels, so that clearing the board touches only them.
+    std::vector<uint32_t> eaten;
+    std::vector<player_number_t> eliminated;
+    size_t followed;
+    event_no_t header_events;
+    // Watermark of the last started snapshot.
+    event_no_t last_watermark;
+
+    // Snapshot being built, [nullptr] if none.
+    std::unique_ptr<BoardSnapshot> building;
+    uint32_t scan_position;
+    uint32_t run_start;
+    uint32_t run_length;
+    uint16_t run_owner;
+    Buffer part;
+    // Owner of the previous eaten run of the current part, 0 if none.
+    uint16_t part_owner;
+    uint16_t part_eliminated;
+    bool part_has_runs;
+
+    std::shared_ptr<const BoardSnapshot> snapshot;
+    uint64_t snapshots_built;
+};
+
+/*
+ * Eaten run of a decoded snapshot part.
+ */
+struct snapshot_run_t {
+    uint32_t position;
+    uint32_t length;
+    player_number_t owner;
+};
+
+struct snapshot_part_t {
+    game_id_t game_id;
+    event_no_t watermark;
+    event_no_t header_events;
+    uint16_t part;
+    uint16_t parts;
+    std::vector<player_number_t> eliminated;
+    std::vector<snapshot_run_t> runs;
+};
+
+/*
+ * Returns [true] if datagram [data] of [len] bytes is a snapshot part rather than
+ * a datagram of events.
+ */
+bool is_snapshot_part(const char *data, size_t len);
+
+/*
+ * Returns [true] if checksum of snapshot part [data] of [len] bytes is valid.
+ */
+bool verify_snapshot_part(const char *data, size_t len);
+
+/*
+ * Decodes verified snapshot part [data] of [len] bytes into [part]. Returns [false]
+ * if it is malformed.
+ */
+bool decode_snapshot_part(const char *data, size_t len, snapshot_part_t &part);
+
+#endif //SCREEN_WORMS_BOARD_SNAPSHOT_H
@@ -6,7 +6,6 @@
 #include <zconf.h>
 #include <string>
 #include <sys/socket.h>
-#include <regex>
 #include <netinet/in.h>
 #include <cassert>
 #include <queue>
@@ -16,19 +15,19 @@
 
 #define DATAGRAM_SIZE 550
 
-const std::regex player_name_regex(R"([\x21-\x7E]{0,20})");
+// Length of client message fields preceding player name.
+#define CLIENT_MESSAGE_HEADER_LENGTH    (sizeof(session_id_t) + sizeof(uint8_t) + sizeof(event_no_t))
 
 class Buffer {
 public:
     Buffer() : length(0) {}
 
-    size_t get_space_left() const {
-        return DATAGRAM_SIZE - length;
+    size_t get_length() const {
+        return length;
     }
 
-    void set_destination(const struct sockaddr_in6 &destination, socklen_t len) {
-        dest_addr = destination;
-        addr_len = len;
+    size_t get_space_left() const {
+        return DATAGRAM_SIZE - length;
     }
 
     template<typename T, typename = typename std::enable_if<std::is_arithmetic<T>::value, T>::type>
@@ -57,35 +56,36 @@ public:
 
     void insert_string(const std::string &string);
 
+    void insert_bytes(const char *data, size_t len) {
+        assert(length + len <= DATAGRAM_SIZE);
+        memcpy(buf + length, data, len);
+        length += len;
+    }
+
+    void clear() {
+        length = 0;
+    }
+
     /*
-     * Receives message from poll_fds and saves its address to [client_address].
-     * Returns number of received bytes.
+     * Gives access to underlying datagram memory, e.g. for receiving into it.
      */
-    ssize_t receive(int sock, struct sockaddr_in6 &client_address,
-        socklen_t &client_address_len);
+    char *get_data() {
+        return buf;
+    }
+
+    const char *get_data() const {
+        return buf;
+    }
 
     /*
-     * Parses poll_fds message to [message].
+     * Parses client message of [len] bytes to [message] without allocating.
      * Returns [true] is message was valid and [false] otherwise.
      */
     bool parse_client_message(client_message &message, ssize_t len);
 
-    /*
-     * Sends its content to given poll_fds.
-     * Returns [true] if message was properly sent.
-     */
-    bool send_to_client(int sock);
-
-    uint32_t get_crc32(size_t len);
-
-    uint32_t get_crc32();
-
 private:
     char buf[DATAGRAM_SIZE];
     size_t length;
-    struct sockaddr_in6 dest_addr;
-    socklen_t addr_len;
 };
 
-
 #endif //SCREEN_WORMS_BUFFER_H
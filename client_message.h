@@ -1,15 +1,56 @@
 #ifndef SCREEN_WORMS_CLIENT_MESSAGE_H
 #define SCREEN_WORMS_CLIENT_MESSAGE_H
 
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
 using session_id_t = uint64_t;
 using player_name_t = std::string;
 using event_no_t = uint32_t;
 
+// Bit of turn direction byte set by clients that understand wide events.
+#define WIDE_PLAYER_NUMBERS_FLAG    0x80
+// Bit of turn direction byte set by clients that understand compact event datagrams.
+#define COMPACT_EVENTS_FLAG         0x40
+// Bit of turn direction byte set by clients that accept a board snapshot on catch-up.
+#define SNAPSHOT_FLAG               0x20
+
+#define MAX_PLAYER_NAME_LENGTH      20
+
+/*
+ * Player name kept inside a client message, so that decoding a datagram does not
+ * allocate.
+ */
+struct inline_name_t {
+    char bytes[MAX_PLAYER_NAME_LENGTH];
+    uint8_t length;
+
+    void assign(std::string_view name) {
+        assert(name.size() <= MAX_PLAYER_NAME_LENGTH);
+        memcpy(bytes, name.data(), name.size());
+        length = name.size();
+    }
+
+    bool empty() const {
+        return length == 0;
+    }
+
+    std::string_view view() const {
+        return {bytes, length};
+    }
+};
+
 struct client_message {
     session_id_t session_id;
     uint8_t turn_direction;
+    bool wide_player_numbers;
+    bool compact_events;
+    bool snapshots;
     event_no_t next_expected_event_no;
-    player_name_t player_name;
+    inline_name_t player_name;
 };
 
 #endif //SCREEN_WORMS_CLIENT_MESSAGE_H
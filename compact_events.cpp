@@ -0,0 +1,228 @@
+#include "compact_events.h"
+#include "crc32.h"
+#include "varint.h"
+
+namespace {
+    uint16_t read_number16(const char *data) {
+        uint16_t n;
+        memcpy(&n, data, sizeof(n));
+        return be16toh(n);
+    }
+
+    uint32_t read_number32(const char *data) {
+        uint32_t n;
+        memcpy(&n, data, sizeof(n));
+        return be32toh(n);
+    }
+
+    template<typename T>
+    void append_number(std::vector<char> &out, T n) {
+        switch (sizeof(n)) {
+            case 2:
+                n = htobe16(n);
+                break;
+            case 4:
+                n = htobe32(n);
+                break;
+            default:
+                break;
+        }
+        const char *bytes = reinterpret_cast<const char *>(&n);
+        out.insert(out.end(), bytes, bytes + sizeof(n));
+    }
+
+    bool is_pixel(event_type_t type) {
+        return type == PIXEL || type == WIDE_PIXEL;
+    }
+
+    bool is_elimination(event_type_t type) {
+        return type == PLAYER_ELIMINATED || type == WIDE_PLAYER_ELIMINATED;
+    }
+}
+
+void CompactEncoder::begin(game_id_t game_id, event_no_t first) {
+    // Pixels remembered from earlier datagrams are never used.
+    if (++datagram_no == 0) {
+        last_pixels.assign(last_pixels.size(), compact_pixel_t{0, 0, 0});
+        datagram_no = 1;
+    }
+
+    datagram.clear();
+    datagram.insert_number(game_id);
+    datagram.insert_number(uint8_t(COMPACT_EVENTS_VERSION));
+    char varint[MAX_VARINT_LENGTH];
+    datagram.insert_bytes(varint, put_varint(varint, first));
+}
+
+bool CompactEncoder::add(const char *event) {
+    event_len_t event_len = read_number32(event);
+    event_type_t type = event[sizeof(event_len_t) + sizeof(event_no_t)];
+    const char *data = event + sizeof(event_len_t) + sizeof(event_no_t) + sizeof(event_type_t);
+    size_t data_len = event_len - sizeof(event_no_t) - sizeof(event_type_t);
+    bool extended = type > COMPACT_TYPE_MASK;
+
+    char encoded[1 + 2 * MAX_VARINT_LENGTH + MAX_EVENT_LENGTH];
+    size_t len = 0;
+    encoded[len++] = char(extended ? (type & ~COMPACT_TYPE_MASK) | COMPACT_EXTENDED_TYPE : type);
+    compact_pixel_t *last_pixel = nullptr;
+    compact_pixel_t pixel{};
+
+    if (is_pixel(type)) {
+        size_t number_len = type == PIXEL ? sizeof(legacy_player_number_t) :
+                                            sizeof(player_number_t);
+        player_number_t number = type == PIXEL ? uint8_t(data[0]) : read_number16(data);
+        pixel = {datagram_no, read_number32(data + number_len),
+                 read_number32(data + number_len + sizeof(coordinate_t))};
+        if (number >= last_pixels.size())
+            last_pixels.resize(number + 1, compact_pixel_t{0, 0, 0});
+        last_pixel = &last_pixels[number];
+
+        // Differences of -1, 0 and 1 wrap to 0, 1 and 2.
+        coordinate_t dx = pixel.x - last_pixel->x + 1;
+        coordinate_t dy = pixel.y - last_pixel->y + 1;
+        len += put_varint(encoded + len, number);
+        if (last_pixel->datagram_no == datagram_no && dx <= 2 && dy <= 2) {
+            encoded[0] = char(type | (1 + 3 * dx + dy) << COMPACT_STEP_SHIFT);
+        }
+        else {
+            len += put_varint(encoded + len, pixel.x);
+            len += put_varint(encoded + len, pixel.y);
+        }
+    }
+    else if (is_elimination(type)) {
+        player_number_t number = type == PLAYER_ELIMINATED ? uint8_t(data[0]) :
+                                                             read_number16(data);
+        len += put_varint(encoded + len, number);
+    }
+    else if (type != GAME_OVER) {
+        if (extended)
+            len += put_varint(encoded + len,
+                              data_len << COMPACT_STEP_SHIFT | (type & COMPACT_TYPE_MASK));
+        else
+            len += put_varint(encoded + len, data_len);
+        memcpy(encoded + len, data, data_len);
+        len += data_len;
+    }
+
+    if (len + sizeof(crc32_t) > datagram.get_space_left())
+        return false;
+
+    datagram.insert_bytes(encoded, len);
+    if (last_pixel != nullptr)
+        *last_pixel = pixel;
+    return true;
+}
+
+void CompactEncoder::finish() {
+    datagram.insert_number(compute_crc32(datagram.get_data(), datagram.get_length()));
+}
+
+const Buffer &CompactEncoder::encode(const EventCollection &events, game_id_t game_id,
+                                     event_no_t first, event_no_t &next, size_t last) {
+    begin(game_id, first);
+    next = first;
+    while (next < std::min(last, events.get_size()) && add(events.get_event_data(next)))
+        ++next;
+    finish();
+
+    return datagram;
+}
+
+bool CompactDecoder::verify(const char *data, size_t len) {
+    if (len < sizeof(game_id_t) + sizeof(uint8_t) + 1 + sizeof(crc32_t))
+        return false;
+
+    return compute_crc32(data, len - sizeof(crc32_t)) ==
+        read_number32(data + len - sizeof(crc32_t));
+}
+
+bool CompactDecoder::decode(const char *data, size_t len, std::vector<char> &legacy) {
+    legacy.clear();
+    size_t end = len - sizeof(crc32_t);
+    size_t position = sizeof(game_id_t);
+    if (uint8_t(data[position++]) != COMPACT_EVENTS_VERSION)
+        return false;
+    legacy.insert(legacy.end(), data, data + sizeof(game_id_t));
+
+    uint32_t event_no;
+    if (!get_varint(data, end, position, event_no))
+        return false;
+    if (++datagram_no == 0) {
+        last_pixels.assign(last_pixels.size(), compact_pixel_t{0, 0, 0});
+        datagram_no = 1;
+    }
+
+    while (position < end) {
+        uint8_t tag = data[position++];
+        event_type_t type = tag & COMPACT_TYPE_MASK;
+        uint32_t step = tag >> COMPACT_STEP_SHIFT;
+        // Type above the type bits has its low bits kept with the data length.
+        bool extended = type == COMPACT_EXTENDED_TYPE && step != 0;
+        uint32_t data_len = 0;
+        if (extended) {
+            if (!get_varint(data, end, position, data_len))
+                return false;
+            type = event_type_t(step << COMPACT_STEP_SHIFT | (data_len & COMPACT_TYPE_MASK));
+            data_len >>= COMPACT_STEP_SHIFT;
+            step = 0;
+        }
+        else if (step != 0 && !is_pixel(type)) {
+            return false;
+        }
+
+        size_t event_start = legacy.size();
+        append_number(legacy, event_len_t(0));
+        append_number(legacy, event_no_t(event_no));
+        append_number(legacy, type);
+
+        if (is_pixel(type) || is_elimination(type)) {
+            uint32_t number;
+            bool legacy_number = type == PIXEL || type == PLAYER_ELIMINATED;
+            if (!get_varint(data, end, position, number) ||
+                number > (legacy_number ? UINT8_MAX : UINT16_MAX)) {
+                return false;
+            }
+            if (legacy_number)
+                append_number(legacy, legacy_player_number_t(number));
+            else
+                append_number(legacy, player_number_t(number));
+
+            if (is_pixel(type)) {
+                if (number >= last_pixels.size())
+                    last_pixels.resize(number + 1, compact_pixel_t{0, 0, 0});
+                compact_pixel_t &pixel = last_pixels[number];
+                if (step != 0) {
+                    if (step > 9 || pixel.datagram_no != datagram_no)
+                        return false;
+                    pixel.x += (step - 1) / 3 - 1;
+                    pixel.y += (step - 1) % 3 - 1;
+                }
+                else if (!get_varint(data, end, position, pixel.x) ||
+                         !get_varint(data, end, position, pixel.y)) {
+                    return false;
+                }
+                pixel.datagram_no = datagram_no;
+                append_number(legacy, pixel.x);
+                append_number(legacy, pixel.y);
+            }
+        }
+        else if (type != GAME_OVER) {
+            if ((!extended && !get_varint(data, end, position, data_len)) ||
+                data_len > end - position ||
+                data_len > MAX_EVENT_LENGTH - EVENT_OVERHEAD) {
+                return false;
+            }
+            legacy.insert(legacy.end(), data + position, data + position + data_len);
+            position += data_len;
+        }
+
+        // Length and checksum are known once the event data is written.
+        event_len_t event_len = htobe32(legacy.size() - event_start - sizeof(event_len_t));
+        memcpy(legacy.data() + event_start, &event_len, sizeof(event_len));
+        append_number(legacy, compute_crc32(legacy.data() + event_start,
+                                            legacy.size() - event_start));
+        ++event_no;
+    }
+
+    return true;
+}
@@ -0,0 +1,115 @@
+#ifndef SCREEN_WORMS_COMPACT_EVENTS_H
+#define SCREEN_WORMS_COMPACT_EVENTS_H
+
+#include <vector>
+
+#include "buffer.h"
+#include "event.h"
+#include "event_collection.h"
+
+// Version of compact encoding, sent right after game id of every compact datagram.
+#define COMPACT_EVENTS_VERSION  1
+// Step of a pixel from the previous one is kept in bits of the tag above event type.
+#define COMPACT_STEP_SHIFT      4
+#define COMPACT_TYPE_MASK       0x0F
+// Type bits of the tag of an event whose type does not fit in them.
+#define COMPACT_EXTENDED_TYPE   0x0F
+
+/*
+ * Previous pixel of a player, valid in datagram [datagram_no] only.
+ */
+struct compact_pixel_t {
+    uint32_t datagram_no;
+    coordinate_t x;
+    coordinate_t y;
+};
+
+/*
+ * Compact encoding of events, sent to clients that set COMPACT_EVENTS_FLAG. It is
+ * produced from the serialized events of [EventCollection], so legacy clients are
+ * served from the same log. A compact datagram holds a run of consecutive events:
+ *
+ *   game_id (4) | version (1) | first event_no (varint) | events | crc32 (4)
+ *
+ * and the checksum covers everything before it. Varints are unsigned LEB128. Every
+ * event starts with a tag whose low 4 bits are the event type:
+ *   - PIXEL and WIDE_PIXEL: high bits are 0 and player number, x and y follow as
+ *     varints, or 1 + 3 * (dx + 1) + (dy + 1) and only player number follows, for
+ *     a pixel one step away from the previous pixel of that player in the datagram,
+ *   - PLAYER_ELIMINATED and WIDE_PLAYER_ELIMINATED: player number as varint,
+ *   - GAME_OVER: nothing,
+ *   - NEW_GAME, WIDE_NEW_GAME, PLAYER_NAMES and other types up to COMPACT_TYPE_MASK:
+ *     data length as varint and event data as in the legacy event,
+ *   - types above COMPACT_TYPE_MASK, which a relay may get from upstream: low bits
+ *     are COMPACT_EXTENDED_TYPE and high bits the high bits of the type, then data
+ *     length shifted left by 4 with the low bits of the type as varint and event data.
+ * Any single event fits in a compact datagram, as it fits in a legacy one.
+ */
+class CompactEncoder {
+public:
+    CompactEncoder() : datagram_no(0) {}
+
+    /*
+     * Starts datagram of game [game_id] whose first event is [first].
+     */
+    void begin(game_id_t game_id, event_no_t first);
+
+    /*
+     * Appends serialized legacy event [event]. Returns [false] and leaves
+     * the datagram unchanged if the event does not fit.
+     */
+    bool add(const char *event);
+
+    /*
+     * Appends checksum of the datagram.
+     */
+    void finish();
+
+    /*
+     * Returns the last finished datagram; valid until the next [begin].
+     */
+    const Buffer &get_datagram() const {
+        return datagram;
+    }
+
+    /*
+     * Returns datagram of game [game_id] holding as many events of [events] before
+     * [last] as fit, starting with event [first]. Number of the first event that did
+     * not fit is saved to [next]. The returned reference is valid until the next call.
+     */
+    const Buffer &encode(const EventCollection &events, game_id_t game_id, event_no_t first,
+                         event_no_t &next, size_t last = SIZE_MAX);
+
+private:
+    Buffer datagram;
+    uint32_t datagram_no;
+    // Indexed by player number.
+    std::vector<compact_pixel_t> last_pixels;
+};
+
+/*
+ * Turns compact datagrams back into legacy serialized events, checksums included.
+ */
+class CompactDecoder {
+public:
+    CompactDecoder() : datagram_no(0) {}
+
+    /*
+     * Returns [true] if checksum of datagram [data] of [len] bytes is valid.
+     */
+    static bool verify(const char *data, size_t len);
+
+    /*
+     * Decodes verified datagram [data] of [len] bytes into [legacy], which receives
+     * game id followed by legacy events, as in a legacy datagram but possibly longer.
+     * Returns [false] if the datagram is malformed.
+     */
+    bool decode(const char *data, size_t len, std::vector<char> &legacy);
+
+private:
+    uint32_t datagram_no;
+    // Indexed by player number.
+    std::vector<compact_pixel_t> last_pixels;
+};
+
+#endif //SCREEN_WORMS_COMPACT_EVENTS_H
@@ -0,0 +1,168 @@
+#include <array>
+#include <cstring>
+#include <endian.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "crc32.h"
+
+namespace {
+    // Reflected CRC-32-IEEE polynomial.
+    constexpr uint32_t POLYNOMIAL = 0xEDB88320U;
+    constexpr size_t SLICES = 8;
+
+    using crc_tables_t = std::array<std::array<uint32_t, 256>, SLICES>;
+
+    /*
+     * Table [k][b] holds the state change caused by byte [b] followed by [k] zero bytes.
+     */
+    constexpr crc_tables_t make_tables() {
+        crc_tables_t tables{};
+        for (uint32_t b = 0; b < 256; ++b) {
+            uint32_t crc = b;
+            for (int bit = 0; bit < 8; ++bit)
+                crc = (crc >> 1) ^ (POLYNOMIAL & (0 - (crc & 1)));
+            tables[0][b] = crc;
+        }
+        for (size_t k = 1; k < SLICES; ++k) {
+            for (uint32_t b = 0; b < 256; ++b)
+                tables[k][b] = (tables[k - 1][b] >> 8) ^ tables[0][tables[k - 1][b] & 0xFF];
+        }
+        return tables;
+    }
+
+    constexpr crc_tables_t crc_tables = make_tables();
+
+    uint32_t update_bytewise(uint32_t state, const char *data, size_t len) {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < len; ++i)
+            state = (state >> 8) ^ crc_tables[0][(state ^ bytes[i]) & 0xFF];
+        return state;
+    }
+
+    /*
+     * Consumes eight bytes per step with one lookup in each table.
+     */
+    uint32_t update_slicing_by_8(uint32_t state, const char *data, size_t len) {
+        const auto *bytes = reinterpret_cast<const uint8_t *>(data);
+        for (; len >= SLICES; len -= SLICES, bytes += SLICES) {
+            uint32_t low, high;
+            memcpy(&low, bytes, sizeof(low));
+            memcpy(&high, bytes + 4, sizeof(high));
+            low = htole32(low) ^ state;
+            high = htole32(high);
+            state = crc_tables[7][low & 0xFF] ^ crc_tables[6][(low >> 8) & 0xFF] ^
+                    crc_tables[5][(low >> 16) & 0xFF] ^ crc_tables[4][low >> 24] ^
+                    crc_tables[3][high & 0xFF] ^ crc_tables[2][(high >> 8) & 0xFF] ^
+                    crc_tables[1][(high >> 16) & 0xFF] ^ crc_tables[0][high >> 24];
+        }
+        return update_bytewise(state, reinterpret_cast<const char *>(bytes), len);
+    }
+
+#if defined(__x86_64__)
+    // Shortest input worth folding; shorter inputs and the tail go through slicing-by-8.
+    constexpr size_t FOLD_MIN_LENGTH = 64;
+
+    __attribute__((target("pclmul,sse4.1")))
+    inline __m128i load_block(const char *data) {
+        return _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+    }
+
+    /*
+     * Folds 128 bits of [x] over the next block with constants [k].
+     */
+    __attribute__((target("pclmul,sse4.1")))
+    inline __m128i fold(__m128i x, __m128i next, __m128i k) {
+        return _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x, k, 0x00),
+                                           _mm_clmulepi64_si128(x, k, 0x11)), next);
+    }
+
+    /*
+     * Folds 16-byte blocks with carry-less multiplication, as described in "Fast CRC
+     * Computation for Generic Polynomials Using PCLMULQDQ Instruction" by Intel, then
+     * reduces the remainder to 32 bits with Barrett reduction. Constants are powers
+     * of x modulo the bit-reflected polynomial.
+     */
+    __attribute__((target("pclmul,sse4.1")))
+    uint32_t fold_pclmul(uint32_t state, const char *data, size_t len) {
+        const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+        const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+        const __m128i k5 = _mm_set_epi64x(0, 0x0163cd6124);
+        const __m128i barrett = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+        const __m128i low_words = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        __m128i x1 = _mm_xor_si128(load_block(data), _mm_cvtsi32_si128(int(state)));
+        __m128i x2 = load_block(data + 16);
+        __m128i x3 = load_block(data + 32);
+        __m128i x4 = load_block(data + 48);
+        data += 64;
+        len -= 64;
+
+        // Four independent streams hide latency of the multiplications.
+        for (; len >= 64; data += 64, len -= 64) {
+            x1 = fold(x1, load_block(data), k1k2);
+            x2 = fold(x2, load_block(data + 16), k1k2);
+            x3 = fold(x3, load_block(data + 32), k1k2);
+            x4 = fold(x4, load_block(data + 48), k1k2);
+        }
+
+        x1 = fold(x1, x2, k3k4);
+        x1 = fold(x1, x3, k3k4);
+        x1 = fold(x1, x4, k3k4);
+        for (; len >= 16; data += 16, len -= 16)
+            x1 = fold(x1, load_block(data), k3k4);
+
+        // Folds 128 bits to 64 bits.
+        x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, low_words);
+        x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5, 0x00), x2);
+
+        // Barrett reduction to 32 bits.
+        x2 = _mm_and_si128(x1, low_words);
+        x2 = _mm_clmulepi64_si128(x2, barrett, 0x10);
+        x2 = _mm_and_si128(x2, low_words);
+        x2 = _mm_clmulepi64_si128(x2, barrett, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return uint32_t(_mm_extract_epi32(x1, 1));
+    }
+
+    uint32_t update_pclmul(uint32_t state, const char *data, size_t len) {
+        if (len >= FOLD_MIN_LENGTH) {
+            size_t folded = len & ~size_t(15);
+            state = fold_pclmul(state, data, folded);
+            data += folded;
+            len -= folded;
+        }
+        return update_slicing_by_8(state, data, len);
+    }
+
+    bool pclmul_supported() {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    }
+#endif
+
+    std::vector<crc32_kernel_t> find_kernels() {
+        std::vector<crc32_kernel_t> kernels{{"bytewise",     update_bytewise},
+                                            {"slicing-by-8", update_slicing_by_8}};
+#if defined(__x86_64__)
+        if (pclmul_supported())
+            kernels.push_back({"pclmulqdq", update_pclmul});
+#endif
+        return kernels;
+    }
+}
+
+const std::vector<crc32_kernel_t> &get_crc32_kernels() {
+    static const std::vector<crc32_kernel_t> kernels = find_kernels();
+    return kernels;
+}
+
+uint32_t crc32_update(uint32_t state, const char *data, size_t len) {
+    static const crc32_update_t fastest = get_crc32_kernels().back().update;
+    return fastest(state, data, len);
+}
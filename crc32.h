@@ -0,0 +1,62 @@
+#ifndef SCREEN_WORMS_CRC32_H
+#define SCREEN_WORMS_CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Internal state of a fresh checksum; the checksum is its state with all bits flipped.
+#define CRC32_INITIAL   0xFFFFFFFFU
+
+/*
+ * Updates internal CRC-32-IEEE [state] with [len] bytes at [data].
+ */
+using crc32_update_t = uint32_t (*)(uint32_t state, const char *data, size_t len);
+
+struct crc32_kernel_t {
+    const char *name;
+    crc32_update_t update;
+};
+
+/*
+ * Returns all implementations supported by this CPU, slowest first.
+ */
+const std::vector<crc32_kernel_t> &get_crc32_kernels();
+
+/*
+ * Updates [state] with the fastest implementation supported by this CPU, which is
+ * selected once at run time.
+ */
+uint32_t crc32_update(uint32_t state, const char *data, size_t len);
+
+/*
+ * Computes CRC-32-IEEE checksum of [len] bytes at [data].
+ */
+inline uint32_t compute_crc32(const char *data, size_t len) {
+    return crc32_update(CRC32_INITIAL, data, len) ^ CRC32_INITIAL;
+}
+
+/*
+ * Checksum computed incrementally over consecutive pieces of data.
+ */
+class Crc32 {
+public:
+    Crc32() : state(CRC32_INITIAL) {}
+
+    void update(const char *data, size_t len) {
+        state = crc32_update(state, data, len);
+    }
+
+    uint32_t get_value() const {
+        return state ^ CRC32_INITIAL;
+    }
+
+    void reset() {
+        state = CRC32_INITIAL;
+    }
+
+private:
+    uint32_t state;
+};
+
+#endif //SCREEN_WORMS_CRC32_H
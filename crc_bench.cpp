@@ -0,0 +1,108 @@
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "crc32.h"
+
+/*
+ * Checks every CRC-32 kernel supported by this CPU against known checksums and
+ * against each other, then prints throughput of each kernel for lengths of a pixel
+ * event, a full datagram and long buffers.
+ */
+namespace {
+    constexpr size_t BYTES_PER_MEASUREMENT = size_t(1) << 28;
+
+    struct known_vector_t {
+        const char *data;
+        uint32_t crc;
+    };
+
+    const known_vector_t KNOWN_VECTORS[] = {
+            {"",                                            0x00000000},
+            {"a",                                           0xE8B7BE43},
+            {"abc",                                         0x352441C2},
+            {"123456789",                                   0xCBF43926},
+            {"The quick brown fox jumps over the lazy dog", 0x414FA339},
+    };
+
+    uint32_t checksum(const crc32_kernel_t &kernel, const char *data, size_t len) {
+        return kernel.update(CRC32_INITIAL, data, len) ^ CRC32_INITIAL;
+    }
+
+    bool check(const crc32_kernel_t &kernel, const std::vector<char> &random) {
+        for (const auto &vector : KNOWN_VECTORS) {
+            uint32_t crc = checksum(kernel, vector.data, strlen(vector.data));
+            if (crc != vector.crc) {
+                fprintf(stderr, "%s: checksum of \"%s\" is %08x, expected %08x\n", kernel.name,
+                        vector.data, crc, vector.crc);
+                return false;
+            }
+        }
+
+        // Every length and alignment around the folding thresholds, whole and in pieces.
+        const crc32_kernel_t &reference = get_crc32_kernels().front();
+        for (size_t offset = 0; offset < 16; ++offset) {
+            for (size_t len = 0; len <= 1024; ++len) {
+                const char *data = random.data() + offset;
+                uint32_t expected = checksum(reference, data, len);
+                uint32_t split = kernel.update(kernel.update(CRC32_INITIAL, data, len / 3),
+                                               data + len / 3, len - len / 3) ^ CRC32_INITIAL;
+                if (checksum(kernel, data, len) != expected || split != expected) {
+                    fprintf(stderr, "%s: wrong checksum of %zu bytes at offset %zu\n",
+                            kernel.name, len, offset);
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    double measure(const crc32_kernel_t &kernel, const std::vector<char> &random, size_t len) {
+        size_t repetitions = BYTES_PER_MEASUREMENT / len;
+        uint32_t state = CRC32_INITIAL;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < repetitions; ++i)
+            state = kernel.update(state, random.data(), len);
+        auto end = std::chrono::steady_clock::now();
+
+        // Keeps the compiler from dropping the loop.
+        volatile uint32_t sink = state;
+        (void) sink;
+
+        double seconds = std::chrono::duration<double>(end - start).count();
+        return double(repetitions * len) / seconds / 1e9;
+    }
+}
+
+int main() {
+    std::vector<char> random(size_t(1) << 20);
+    uint32_t seed = 1;
+    for (auto &byte : random) {
+        seed = seed * 1103515245 + 12345;
+        byte = char(seed >> 16);
+    }
+
+    const auto &kernels = get_crc32_kernels();
+    for (const auto &kernel : kernels) {
+        if (!check(kernel, random))
+            return 1;
+    }
+
+    const size_t lengths[] = {22, 550, 4096, random.size()};
+    printf("kernel");
+    for (size_t len : lengths)
+        printf(",gb_per_s_%zu", len);
+    printf("\n");
+
+    for (const auto &kernel : kernels) {
+        printf("%s", kernel.name);
+        for (size_t len : lengths)
+            printf(",%.2f", measure(kernel, random, len));
+        printf("\n");
+    }
+
+    return 0;
+}
@@ -0,0 +1,157 @@
+#include <chrono>
+#include <cstdio>
+#include <regex>
+#include <vector>
+
+#include "buffer.h"
+
+/*
+ * Compares [Buffer::parse_client_message] with decoding into std::string and
+ * validating the name with std::regex, as the server did before. Both decoders are
+ * first checked to agree on every datagram, then packets per second are printed for
+ * each mix of datagrams.
+ */
+namespace {
+    constexpr size_t DATAGRAMS = 4096;
+    constexpr size_t DECODED_PACKETS = 1 << 22;
+
+    struct datagram_t {
+        Buffer buffer;
+        ssize_t len;
+    };
+
+    struct regex_message_t {
+        session_id_t session_id;
+        uint8_t turn_direction;
+        bool wide_player_numbers;
+        event_no_t next_expected_event_no;
+        std::string player_name;
+    };
+
+    const std::regex player_name_regex(R"([\x21-\x7E]{0,20})");
+
+    /*
+     * Decoder that the server used, restricted to lengths it could handle.
+     */
+    bool parse_with_regex(const Buffer &buffer, regex_message_t &message, ssize_t len) {
+        const char *buf = buffer.get_data();
+        if (len < ssize_t(CLIENT_MESSAGE_HEADER_LENGTH) ||
+            len > ssize_t(CLIENT_MESSAGE_HEADER_LENGTH + MAX_PLAYER_NAME_LENGTH)) {
+            return false;
+        }
+
+        memcpy(&message.session_id, buf, sizeof(message.session_id));
+        message.session_id = be64toh(message.session_id);
+        message.turn_direction = buf[8];
+        message.wide_player_numbers = message.turn_direction & WIDE_PLAYER_NUMBERS_FLAG;
+        message.turn_direction &= ~WIDE_PLAYER_NUMBERS_FLAG;
+        if (message.turn_direction != STRAIGHT && message.turn_direction != LEFT &&
+            message.turn_direction != RIGHT) {
+            return false;
+        }
+        memcpy(&message.next_expected_event_no, buf + 9, sizeof(message.next_expected_event_no));
+        message.next_expected_event_no = be32toh(message.next_expected_event_no);
+
+        message.player_name = std::string(buf + CLIENT_MESSAGE_HEADER_LENGTH,
+                                          len - CLIENT_MESSAGE_HEADER_LENGTH);
+        return regex_match(message.player_name, player_name_regex);
+    }
+
+    /*
+     * Builds datagrams with names of up to [max_name] bytes; about every [invalid]-th
+     * has a byte outside of the allowed range.
+     */
+    std::vector<datagram_t> make_datagrams(size_t max_name, size_t invalid, uint32_t seed) {
+        std::vector<datagram_t> datagrams(DATAGRAMS);
+        for (auto &datagram : datagrams) {
+            seed = seed * 1103515245 + 12345;
+            datagram.buffer.insert_number(uint64_t(seed));
+            datagram.buffer.insert_number(uint8_t(seed % 3));
+            datagram.buffer.insert_number(uint32_t(seed >> 8));
+
+            size_t name_length = max_name == 0 ? 0 : (seed >> 4) % (max_name + 1);
+            for (size_t i = 0; i < name_length; ++i) {
+                seed = seed * 1103515245 + 12345;
+                char c = char(0x21 + (seed >> 16) % 94);
+                datagram.buffer.insert_bytes(&c, 1);
+            }
+            if (invalid != 0 && name_length > 0 && (seed >> 8) % invalid == 0) {
+                const char bad[] = {' ', 0x7F, char(0x80), char(0xFF), 0};
+                datagram.buffer.get_data()[CLIENT_MESSAGE_HEADER_LENGTH + name_length / 2] =
+                    bad[(seed >> 12) % sizeof(bad)];
+            }
+            datagram.len = datagram.buffer.get_length();
+        }
+        return datagrams;
+    }
+
+    bool decoders_agree(std::vector<datagram_t> &datagrams) {
+        for (auto &datagram : datagrams) {
+            for (ssize_t len = 0; len <= datagram.len + 2; ++len) {
+                client_message message{};
+                regex_message_t expected{};
+                bool valid = datagram.buffer.parse_client_message(message, len);
+                if (valid != parse_with_regex(datagram.buffer, expected, len))
+                    return false;
+                if (valid && (message.session_id != expected.session_id ||
+                              message.turn_direction != expected.turn_direction ||
+                              message.wide_player_numbers != expected.wide_player_numbers ||
+                              message.next_expected_event_no != expected.next_expected_event_no ||
+                              message.player_name.view() != expected.player_name)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    template<typename Decode>
+    double measure(std::vector<datagram_t> &datagrams, Decode decode) {
+        size_t accepted = 0;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < DECODED_PACKETS; ++i)
+            accepted += decode(datagrams[i % DATAGRAMS]);
+        auto end = std::chrono::steady_clock::now();
+
+        // Keeps the compiler from dropping the loop.
+        volatile size_t sink = accepted;
+        (void) sink;
+
+        return DECODED_PACKETS / std::chrono::duration<double>(end - start).count();
+    }
+}
+
+int main() {
+    struct mix_t {
+        const char *name;
+        size_t max_name;
+        size_t invalid;
+    };
+    const mix_t mixes[] = {
+            {"spectators",   0,                      0},
+            {"short_names",  8,                      0},
+            {"long_names",   MAX_PLAYER_NAME_LENGTH, 0},
+            {"some_invalid", MAX_PLAYER_NAME_LENGTH, 4},
+    };
+
+    printf("mix,regex_packets_per_s,decoder_packets_per_s,speedup\n");
+    for (const auto &mix : mixes) {
+        auto datagrams = make_datagrams(mix.max_name, mix.invalid, 1);
+        if (!decoders_agree(datagrams)) {
+            fprintf(stderr, "%s: decoders disagree\n", mix.name);
+            return 1;
+        }
+
+        double regex = measure(datagrams, [](datagram_t &datagram) {
+            regex_message_t message;
+            return parse_with_regex(datagram.buffer, message, datagram.len);
+        });
+        double decoder = measure(datagrams, [](datagram_t &datagram) {
+            client_message message;
+            return datagram.buffer.parse_client_message(message, datagram.len);
+        });
+        printf("%s,%.0f,%.0f,%.1f\n", mix.name, regex, decoder, decoder / regex);
+    }
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#include <cmath>
+#include <cstdio>
+
+/*
+ * Prints header with unit vectors of all integer directions. Values are computed by
+ * the same libm calls the game used at run time and printed as exact hexadecimal
+ * literals, so movement along the table is bit-identical to calling cos and sin.
+ */
+int main() {
+    printf("#ifndef SCREEN_WORMS_DIRECTION_TABLE_H\n");
+    printf("#define SCREEN_WORMS_DIRECTION_TABLE_H\n\n");
+    printf("// Generated by direction_table_gen, do not edit.\n\n");
+
+    const char *names[2] = {"DIRECTION_DX", "DIRECTION_DY"};
+    for (int axis = 0; axis < 2; ++axis) {
+        printf("const double %s[360] = {\n", names[axis]);
+        for (int d = 0; d < 360; ++d) {
+            // Keeps the compiler from folding the calls with its own arithmetic.
+            volatile double direction = d;
+            double angle = direction * M_PI / 180.0;
+            printf("    %a,\n", axis == 0 ? cos(angle) : sin(angle));
+        }
+        printf("};\n\n");
+    }
+
+    printf("#endif //SCREEN_WORMS_DIRECTION_TABLE_H\n");
+    return 0;
+}
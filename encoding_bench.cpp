@@ -0,0 +1,232 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+
+#include "compact_events.h"
+#include "game_state.h"
+
+/*
+ * Plays games with random inputs over a few board sizes and player counts and
+ * measures, per game, bytes that a single client receives in legacy and compact
+ * datagrams: broadcasts of every round's events and a full catch-up of a client
+ * that joins when the game is over. Every compact datagram is decoded back and
+ * compared with the legacy events. Packing is timed per event.
+ *
+ * Usage: encoding-bench [-r rounds]
+ */
+namespace {
+    constexpr size_t DEFAULT_ROUNDS = 5000;
+    constexpr uint32_t SEED = 1;
+
+    struct config_t {
+        coordinate_t board;
+        size_t players;
+    };
+
+    struct traffic_t {
+        size_t datagrams;
+        size_t bytes;
+        double pack_ns;
+    };
+
+    struct result_t {
+        size_t games;
+        size_t events;
+        traffic_t legacy_broadcast;
+        traffic_t compact_broadcast;
+        traffic_t legacy_catch_up;
+        traffic_t compact_catch_up;
+    };
+
+    class Bench {
+    public:
+        explicit Bench(const config_t &config) : config(config), result{} {}
+
+        result_t run(size_t rounds);
+
+    private:
+        /*
+         * Packs events from [first] to the end of [events] both ways.
+         */
+        void pack(EventCollection &events, game_id_t game_id, event_no_t first,
+                  traffic_t &legacy, traffic_t &compact);
+
+        /*
+         * Checks that compact datagram [datagram] decodes to events of [events] from
+         * [first] to [next] (exclusive).
+         */
+        void verify(const EventCollection &events, const Buffer &datagram, event_no_t first,
+                    event_no_t next);
+
+    private:
+        config_t config;
+        result_t result;
+        CompactEncoder encoder;
+        CompactDecoder decoder;
+        std::vector<char> decoded;
+    };
+
+    double elapsed_ns(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    void Bench::pack(EventCollection &events, game_id_t game_id, event_no_t first,
+                     traffic_t &legacy, traffic_t &compact) {
+        auto start = std::chrono::steady_clock::now();
+        for (event_no_t next = first; next < events.get_size(); ) {
+            const Buffer &datagram = events.get_datagram(game_id, next, next);
+            ++legacy.datagrams;
+            legacy.bytes += datagram.get_length();
+        }
+        legacy.pack_ns += elapsed_ns(start);
+
+        start = std::chrono::steady_clock::now();
+        for (event_no_t next = first; next < events.get_size(); ) {
+            const Buffer &datagram = encoder.encode(events, game_id, next, next);
+            ++compact.datagrams;
+            compact.bytes += datagram.get_length();
+        }
+        compact.pack_ns += elapsed_ns(start);
+
+        // Datagrams are packed again to be checked out of the timed loop.
+        for (event_no_t next = first; next < events.get_size(); ) {
+            event_no_t datagram_first = next;
+            const Buffer &datagram = encoder.encode(events, game_id, datagram_first, next);
+            verify(events, datagram, datagram_first, next);
+        }
+    }
+
+    void Bench::verify(const EventCollection &events, const Buffer &datagram, event_no_t first,
+                       event_no_t next) {
+        size_t expected = events.get_bytes_between(first, next);
+        if (!CompactDecoder::verify(datagram.get_data(), datagram.get_length()) ||
+            !decoder.decode(datagram.get_data(), datagram.get_length(), decoded) ||
+            decoded.size() != sizeof(game_id_t) + expected ||
+            memcmp(decoded.data() + sizeof(game_id_t), events.get_event_data(first),
+                   expected) != 0) {
+            fprintf(stderr, "compact datagram of events %u to %u does not decode back\n",
+                    first, next);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    result_t Bench::run(size_t rounds) {
+        server_params_t params{};
+        params.width = config.board;
+        params.height = config.board;
+        params.turning_speed = 6;
+        params.rounds_per_second = 50;
+        RandomGenerator generator(SEED);
+        GameState game_state;
+        uint64_t random = SEED;
+
+        for (size_t i = 0; i < config.players; ++i) {
+            client_message message{};
+            message.session_id = i;
+            message.turn_direction = STRAIGHT;
+            message.wide_player_numbers = true;
+            message.player_name.assign("player" + std::to_string(i));
+            game_state.add_new_player(i, message);
+        }
+
+        game_id_t game_id = game_state.get_game_id();
+        bool caught_up = true;
+        for (size_t round = 0; round < rounds; ++round) {
+            // Keys change in about every tenth round; in a break all players press one.
+            for (size_t i = 0; i < config.players; ++i) {
+                random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+                uint32_t bits = random >> 33;
+                if (!game_state.in_game())
+                    game_state.change_pressed_key(i, LEFT);
+                else if (bits % 10 == 0)
+                    game_state.change_pressed_key(i, turn_direction_t(bits / 10 % 3));
+            }
+
+            game_state.new_round(params, generator);
+            auto &events = game_state.get_events();
+            if (game_state.get_game_id() != game_id) {
+                game_id = game_state.get_game_id();
+                caught_up = false;
+            }
+
+            pack(events, game_id, events.get_next_for_broadcast(), result.legacy_broadcast,
+                 result.compact_broadcast);
+            events.all_broadcasted();
+
+            // Game is over once its last event is GAME_OVER.
+            size_t size = events.get_size();
+            if (!caught_up && size > 0 &&
+                events.get_event_data(size - 1)[sizeof(event_len_t) + sizeof(event_no_t)] ==
+                    GAME_OVER) {
+                caught_up = true;
+                ++result.games;
+                result.events += size;
+                pack(events, game_id, 0, result.legacy_catch_up, result.compact_catch_up);
+            }
+        }
+
+        return result;
+    }
+
+    void print(const config_t &config, const result_t &result) {
+        if (result.games == 0) {
+            printf("%u,%zu,0,,,,,,,,,\n", config.board, config.players);
+            return;
+        }
+
+        auto per_game = [&](const traffic_t &traffic) {
+            return double(traffic.bytes) / result.games;
+        };
+        // Broadcasts cover the same events as catch-ups, games in progress aside.
+        auto ns_per_event = [&](const traffic_t &broadcast, const traffic_t &catch_up) {
+            return (broadcast.pack_ns + catch_up.pack_ns) / (2.0 * result.events);
+        };
+
+        printf("%u,%zu,%zu,%.0f,%.0f,%.0f,%.2f,%.0f,%.0f,%.2f,%.1f,%.1f\n", config.board,
+               config.players, result.games, double(result.events) / result.games,
+               per_game(result.legacy_broadcast), per_game(result.compact_broadcast),
+               per_game(result.legacy_broadcast) / per_game(result.compact_broadcast),
+               per_game(result.legacy_catch_up), per_game(result.compact_catch_up),
+               per_game(result.legacy_catch_up) / per_game(result.compact_catch_up),
+               ns_per_event(result.legacy_broadcast, result.legacy_catch_up),
+               ns_per_event(result.compact_broadcast, result.compact_catch_up));
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t rounds = DEFAULT_ROUNDS;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rounds = strtoul(optarg, nullptr, 10);
+                if (rounds == 0)
+                    exit(EXIT_FAILURE);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r rounds]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("board,players,games,events_per_game,legacy_broadcast_bytes_per_game,"
+           "compact_broadcast_bytes_per_game,broadcast_ratio,legacy_catch_up_bytes_per_game,"
+           "compact_catch_up_bytes_per_game,catch_up_ratio,legacy_ns_per_event,"
+           "compact_ns_per_event\n");
+    fflush(stdout);
+
+    const coordinate_t boards[] = {64, 256, 1024, 4096};
+    const size_t player_counts[] = {2, 8, 25, 200, 1000};
+    for (coordinate_t board : boards) {
+        for (size_t players : player_counts) {
+            config_t config{board, players};
+            print(config, Bench(config).run(rounds));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include "event_collection.h"
+
+namespace {
+    /*
+     * Returns end of names, starting with [first], that fit in one event next to
+     * [data_len] bytes of other event data, and adds their length to [data_len].
+     * Names of a legacy game always fit.
+     */
+    size_t fit_names(const std::vector<player_name_t> &names, size_t first, bool wide,
+                     size_t &data_len) {
+        size_t last = first;
+        for (; last < names.size(); ++last) {
+            size_t name_len = names[last].length() + 1;
+            if (wide && last > first && EVENT_OVERHEAD + data_len + name_len > MAX_EVENT_LENGTH)
+                break;
+            data_len += name_len;
+        }
+        return last;
+    }
+}
+
+void EventCollection::begin_event(event_type_t type, size_t data_len) {
+    event_crc.reset();
+    append_number(event_len_t(sizeof(event_no_t) + sizeof(event_type_t) + data_len));
+    append_number(event_no_t(get_size()));
+    append_number(type);
+}
+
+void EventCollection::end_event() {
+    crc32_t crc = htobe32(event_crc.get_value());
+    const char *bytes = reinterpret_cast<const char *>(&crc);
+    log.insert(log.end(), bytes, bytes + sizeof(crc));
+    event_offsets.push_back(log.size());
+}
+
+void EventCollection::add_new_game(coordinate_t maxx, coordinate_t maxy,
+                                   const std::vector<player_name_t> &names, bool wide) {
+    size_t data_len = 2 * sizeof(coordinate_t) + (wide ? sizeof(player_number_t) : 0);
+    size_t next = 0;
+    size_t last = fit_names(names, next, wide, data_len);
+
+    begin_event(wide ? WIDE_NEW_GAME : NEW_GAME, data_len);
+    append_number(maxx);
+    append_number(maxy);
+    if (wide)
+        append_number(player_number_t(names.size()));
+
+    // Names that do not fit are moved to PLAYER_NAMES events.
+    while (true) {
+        for (; next < last; ++next)
+            append_string(names[next]);
+        end_event();
+        if (next == names.size())
+            break;
+
+        data_len = 0;
+        last = fit_names(names, next, wide, data_len);
+        begin_event(PLAYER_NAMES, data_len);
+    }
+}
+
+void EventCollection::add_pixel(player_number_t number, coordinate_t x, coordinate_t y,
+                                bool wide) {
+    size_t number_len = wide ? sizeof(player_number_t) : sizeof(legacy_player_number_t);
+    begin_event(wide ? WIDE_PIXEL : PIXEL, number_len + 2 * sizeof(coordinate_t));
+    if (wide)
+        append_number(number);
+    else
+        append_number(legacy_player_number_t(number));
+    append_number(x);
+    append_number(y);
+    end_event();
+}
+
+void EventCollection::add_player_eliminated(player_number_t number, bool wide) {
+    if (wide) {
+        begin_event(WIDE_PLAYER_ELIMINATED, sizeof(player_number_t));
+        append_number(number);
+    }
+    else {
+        begin_event(PLAYER_ELIMINATED, sizeof(legacy_player_number_t));
+        append_number(legacy_player_number_t(number));
+    }
+    end_event();
+}
+
+void EventCollection::add_game_over() {
+    begin_event(GAME_OVER, 0);
+    end_event();
+}
+
+const Buffer &EventCollection::get_datagram(game_id_t game_id, event_no_t first,
+                                            event_no_t &next, size_t last) {
+    last_datagram.clear();
+    last_datagram.insert_number(game_id);
+
+    // Puts in datagram as many events as it can.
+    size_t limit = event_offsets[first] + last_datagram.get_space_left();
+    auto end = event_offsets.begin() + std::min(last, get_size()) + 1;
+    next = std::upper_bound(event_offsets.begin() + first, end, limit) -
+        event_offsets.begin() - 1;
+    last_datagram.insert_bytes(log.data() + event_offsets[first],
+                               event_offsets[next] - event_offsets[first]);
+
+    return last_datagram;
+}
@@ -1,45 +1,130 @@
 #ifndef SCREEN_WORMS_EVENT_COLLECTION_H
 #define SCREEN_WORMS_EVENT_COLLECTION_H
 
-#include <memory>
+#include <algorithm>
+#include <vector>
 
+#include "crc32.h"
 #include "event.h"
 
+/*
+ * Append-only log of events of the current game. Every event is serialized once when
+ * added, checksum included, into a contiguous byte log indexed by event offsets, so
+ * a datagram is packed by copying a single range of the log.
+ */
 class EventCollection {
 public:
-    EventCollection() : next_for_broadcast(0) {}
+    EventCollection() : event_offsets{0}, next_for_broadcast(0) {}
 
     size_t get_size() const {
-        return events.size();
+        return event_offsets.size() - 1;
     }
     
     size_t get_next_for_broadcast() const {
         return next_for_broadcast;
     }
 
-    std::shared_ptr<Event> get_event(size_t index) const {
-        if (index >= events.size())
-            return nullptr;
+    /*
+     * Returns total length of events from [first] to [last] (exclusive).
+     */
+    size_t get_bytes_between(size_t first, size_t last) const {
+        return event_offsets[std::min(last, get_size())] -
+            event_offsets[std::min(first, get_size())];
+    }
 
-        return events[index];
+    /*
+     * Returns serialized event [event]; events that follow it are stored right after it.
+     */
+    const char *get_event_data(size_t event) const {
+        return log.data() + event_offsets[std::min(event, get_size())];
     }
 
     void all_broadcasted() {
-        next_for_broadcast = events.size();
+        next_for_broadcast = get_size();
     }
 
-    void add_event(const std::shared_ptr<Event> &event) {
-        events.push_back(event);
+    /*
+     * Adds NEW_GAME event listing [names]. Wide game is announced with WIDE_NEW_GAME
+     * followed by PLAYER_NAMES events, so that every event fits in a datagram.
+     */
+    void add_new_game(coordinate_t maxx, coordinate_t maxy, const std::vector<player_name_t> &names,
+                      bool wide);
+
+    void add_pixel(player_number_t number, coordinate_t x, coordinate_t y, bool wide);
+
+    void add_player_eliminated(player_number_t number, bool wide);
+
+    void add_game_over();
+
+    /*
+     * Appends event serialized by another server, checksum included.
+     */
+    void add_serialized(const char *event, size_t len) {
+        log.insert(log.end(), event, event + len);
+        event_offsets.push_back(log.size());
     }
 
     void clear() {
-        events.clear();
+        log.clear();
+        event_offsets.resize(1);
         next_for_broadcast = 0;
     }
 
+    /*
+     * Returns datagram of game [game_id] holding as many events before [last] as fit,
+     * starting with event [first]. Number of the first event that did not fit is saved
+     * to [next]. The returned reference is valid until the next call.
+     */
+    const Buffer &get_datagram(game_id_t game_id, event_no_t first, event_no_t &next,
+                               size_t last = SIZE_MAX);
+
+private:
+    /*
+     * Appends event bytes to the log and to the checksum of the current event.
+     */
+    void append_bytes(const char *bytes, size_t len) {
+        log.insert(log.end(), bytes, bytes + len);
+        event_crc.update(bytes, len);
+    }
+
+    template<typename T>
+    void append_number(T n) {
+        T num = n;
+        switch (sizeof(num)) {
+            case 2:
+                num = htobe16(num);
+                break;
+            case 4:
+                num = htobe32(num);
+                break;
+            default:
+                break;
+        }
+
+        append_bytes(reinterpret_cast<const char *>(&num), sizeof(num));
+    }
+
+    void append_string(const player_name_t &string) {
+        append_bytes(string.c_str(), string.length() + 1);
+    }
+
+    /*
+     * Writes header of a new event with [data_len] bytes of event data.
+     */
+    void begin_event(event_type_t type, size_t data_len);
+
+    /*
+     * Appends checksum of the current event, computed while it was written, and indexes it.
+     */
+    void end_event();
+
 private:
-    std::vector<std::shared_ptr<Event>> events;
+    std::vector<char> log;
+    // Offset of every event in [log]; has one extra entry.
+    std::vector<size_t> event_offsets;
     size_t next_for_broadcast;
+    Crc32 event_crc;
+    Buffer last_datagram;
 };
 
 
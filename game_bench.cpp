@@ -0,0 +1,219 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <new>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "game_state.h"
+
+/*
+ * Drives [GameState] with scripted and random inputs over many board sizes, player
+ * counts and turning speeds, and prints one record per configuration as CSV or, with
+ * -j, as JSON lines. Every configuration runs in its own process, so that peak RSS
+ * is its own. Only [GameState::new_round] is timed; allocations are counted within it.
+ *
+ * Usage: game-bench [-r rounds] [-j]
+ */
+namespace {
+    constexpr size_t DEFAULT_ROUNDS = 2000;
+    constexpr uint32_t SEED = 1;
+
+    // Number of allocations made by operator new since start.
+    size_t allocations = 0;
+
+    enum inputs_t {
+        SCRIPTED,
+        RANDOM
+    };
+
+    struct config_t {
+        coordinate_t board;
+        size_t players;
+        int turning_speed;
+        inputs_t inputs;
+    };
+
+    struct result_t {
+        size_t rounds;
+        size_t games;
+        size_t worm_steps;
+        size_t events;
+        size_t allocations;
+        double total_ns;
+    };
+
+    /*
+     * During a break every player presses an arrow, so games follow one another.
+     * In a game a scripted player cycles through turning left, right and going
+     * straight; a random one changes its key in about every tenth round.
+     */
+    turn_direction_t next_key(const config_t &config, size_t player, size_t round,
+                              turn_direction_t key, bool in_game, uint64_t &random) {
+        random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+        uint32_t bits = random >> 33;
+        if (!in_game)
+            return config.inputs == SCRIPTED || bits % 2 == 0 ? LEFT : RIGHT;
+        if (config.inputs == SCRIPTED)
+            return turn_direction_t((round / 20 + player) % 3);
+        return bits % 10 == 0 ? turn_direction_t(bits / 10 % 3) : key;
+    }
+
+    result_t run(const config_t &config, size_t rounds) {
+        server_params_t params{};
+        params.width = config.board;
+        params.height = config.board;
+        params.turning_speed = config.turning_speed;
+        params.rounds_per_second = 50;
+        RandomGenerator generator(SEED);
+        GameState game_state;
+        std::vector<turn_direction_t> keys(config.players, STRAIGHT);
+        uint64_t random = SEED;
+
+        for (size_t i = 0; i < config.players; ++i) {
+            client_message message{};
+            message.session_id = i;
+            message.turn_direction = STRAIGHT;
+            message.wide_player_numbers = true;
+            message.player_name.assign("player" + std::to_string(i));
+            game_state.add_new_player(i, message);
+        }
+
+        result_t result{0, 0, 0, 0, 0, 0};
+        game_id_t game_id = game_state.get_game_id();
+        for (size_t round = 0; round < rounds; ++round) {
+            for (size_t i = 0; i < config.players; ++i) {
+                keys[i] = next_key(config, i, round, keys[i], game_state.in_game(), random);
+                game_state.change_pressed_key(i, keys[i]);
+            }
+
+            auto &events = game_state.get_events();
+            size_t events_before = events.get_size();
+            size_t worms = game_state.get_worm_count();
+            size_t allocations_before = allocations;
+
+            auto start = std::chrono::steady_clock::now();
+            game_state.new_round(params, generator);
+            result.total_ns += std::chrono::duration<double, std::nano>(
+                    std::chrono::steady_clock::now() - start).count();
+
+            result.allocations += allocations - allocations_before;
+            result.worm_steps += worms;
+            ++result.rounds;
+            // Events were cleared if a new game started.
+            if (game_state.get_game_id() != game_id) {
+                game_id = game_state.get_game_id();
+                ++result.games;
+                events_before = 0;
+            }
+            result.events += events.get_size() - events_before;
+            events.all_broadcasted();
+        }
+
+        return result;
+    }
+
+    void print(const config_t &config, const result_t &result, bool json) {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+
+        const char *inputs = config.inputs == SCRIPTED ? "scripted" : "random";
+        double seconds = result.total_ns / 1e9;
+        double rounds_per_s = result.rounds / seconds;
+        double ns_per_step = result.worm_steps > 0 ? result.total_ns / result.worm_steps : 0;
+        double events_per_s = result.events / seconds;
+        double allocations_per_round = double(result.allocations) / result.rounds;
+
+        if (json) {
+            printf("{\"board\": %u, \"players\": %zu, \"turning_speed\": %d, \"inputs\": \"%s\", "
+                   "\"rounds\": %zu, \"games\": %zu, \"rounds_per_s\": %.0f, "
+                   "\"ns_per_worm_step\": %.2f, \"events_per_s\": %.0f, "
+                   "\"allocations_per_round\": %.3f, \"peak_rss_kb\": %ld}\n",
+                   config.board, config.players, config.turning_speed, inputs, result.rounds,
+                   result.games, rounds_per_s, ns_per_step, events_per_s, allocations_per_round,
+                   usage.ru_maxrss);
+        }
+        else {
+            printf("%u,%zu,%d,%s,%zu,%zu,%.0f,%.2f,%.0f,%.3f,%ld\n", config.board,
+                   config.players, config.turning_speed, inputs, result.rounds, result.games,
+                   rounds_per_s, ns_per_step, events_per_s, allocations_per_round,
+                   usage.ru_maxrss);
+        }
+        fflush(stdout);
+    }
+}
+
+void *operator new(size_t size) {
+    ++allocations;
+    if (void *p = malloc(size == 0 ? 1 : size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+int main(int argc, char *argv[]) {
+    size_t rounds = DEFAULT_ROUNDS;
+    bool json = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:j")) != -1) {
+        switch (opt) {
+            case 'r':
+                rounds = strtoul(optarg, nullptr, 10);
+                if (rounds == 0)
+                    exit(EXIT_FAILURE);
+                break;
+            case 'j':
+                json = true;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r rounds] [-j]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!json) {
+        printf("board,players,turning_speed,inputs,rounds,games,rounds_per_s,ns_per_worm_step,"
+               "events_per_s,allocations_per_round,peak_rss_kb\n");
+        fflush(stdout);
+    }
+
+    const coordinate_t boards[] = {16, 64, 256, 1024, 4096};
+    const size_t player_counts[] = {2, 8, 25, 200};
+    const int turning_speeds[] = {1, 6, 30};
+    for (coordinate_t board : boards) {
+        for (size_t players : player_counts) {
+            for (int turning_speed : turning_speeds) {
+                for (inputs_t inputs : {SCRIPTED, RANDOM}) {
+                    config_t config{board, players, turning_speed, inputs};
+                    pid_t child = fork();
+                    if (child < 0) {
+                        perror("fork");
+                        return 1;
+                    }
+                    if (child == 0) {
+                        print(config, run(config, rounds), json);
+                        _exit(0);
+                    }
+
+                    int status;
+                    if (waitpid(child, &status, 0) < 0 || !WIFEXITED(status) ||
+                        WEXITSTATUS(status) != 0) {
+                        fprintf(stderr, "benchmark of board %u failed\n", board);
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+
+    return 0;
+}
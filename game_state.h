@@ -1,17 +1,24 @@
 #ifndef SCREEN_WORMS_GAME_STATE_H
 #define SCREEN_WORMS_GAME_STATE_H
 
-#include <set>
+#include <vector>
 #include <map>
 
 #include "random_generator.h"
 #include "server_types.h"
 #include "player.h"
 #include "event_collection.h"
+#include "pixel_board.h"
+#include "worms.h"
 
+/*
+ * State of a game. Players are identified by slots of their clients and kept in
+ * arrays indexed by slot.
+ */
 class GameState {
 public:
-    GameState() : game_id(0), phase(BREAK) {}
+    GameState() : game_id(0), games_started(0), keys_pushed(0), names_bytes(0),
+            legacy_players(0), wide_game(false), phase(BREAK) {}
 
     game_id_t get_game_id() const {
         return game_id;
@@ -21,25 +28,67 @@ public:
         return events;
     }
 
+    const EventCollection &get_events() const {
+        return events;
+    }
+
+    bool in_game() const {
+        return phase == GAME;
+    }
+
+    /*
+     * Checks if events of the current game are wide. Clients that did not negotiate
+     * wide events get none of them; they follow from NEW_GAME of the next game.
+     */
+    bool has_wide_events() const {
+        return wide_game;
+    }
+
+    size_t get_worm_count() const {
+        return worms.size();
+    }
+
+    uint64_t get_games_started() const {
+        return games_started;
+    }
+
+    /*
+     * Number of connected clients that have a player name.
+     */
+    size_t get_player_count() const {
+        return active_players.size();
+    }
+
     /*
      * Checks if given player name is already in use.
      */
-    bool player_name_in_use(const player_name_t &player_name) const {
+    bool player_name_in_use(std::string_view player_name) const {
         return active_players.find(player_name) != active_players.end();
     }
 
     /*
-     * Checks if given player name is already in use by any player except for one with
-     * given [identity].
+     * Checks if given player name is already in use by any player except for one in
+     * given [slot].
      */
-    bool player_name_in_use(const player_name_t &player_name,
-                            const client_identity_t &identity) const {
+    bool player_name_in_use(std::string_view player_name, slot_t slot) const {
         auto it = active_players.find(player_name);
-        IdentityComparator cmp;
-        return (it != active_players.end() &&
-            (cmp(it->second, identity) || cmp(identity, it->second)));
+        return it != active_players.end() && it->second != slot;
     }
 
+    /*
+     * Checks if client sending [message] may become a player, replacing the one in
+     * [slot] if given. A lobby that does not fit in a legacy NEW_GAME event takes
+     * only clients that negotiated wide events and only if all its players did.
+     * Spectators are always admitted.
+     */
+    bool may_join(const client_message &message, slot_t slot = NO_SLOT) const;
+
+    /*
+     * Checks if a game of [count] players with names of [bytes] total length
+     * (terminating zeros included) can be announced with a legacy NEW_GAME event.
+     */
+    static bool fits_legacy_new_game(size_t count, size_t bytes);
+
     /*
      * Starts a new round if called during a game.
      * If called during a break between two games (or before the first game), it checks
@@ -48,23 +97,37 @@ public:
     void new_round(server_params_t &params, RandomGenerator &generator);
 
     /*
-     * Changes key recently pressed by given player.
-     * If called during a break,
+     * Changes key recently pressed by player in given slot.
+     * If called during a break, arrow key counts as readiness for a new game.
+     * Returns [true] if the key changed state of the game and [false] if it was a repeat.
      */
-    void change_pressed_key(client_identity_t &identity, turn_direction_t &turn_direction);
+    bool change_pressed_key(slot_t slot, turn_direction_t turn_direction);
+
+    /*
+     * Relay mode: starts mirroring game [id] of upstream server, announced with
+     * WIDE_NEW_GAME if [wide]. Events of the previous mirrored game are dropped.
+     */
+    void mirror_game(game_id_t id, bool wide);
+
+    /*
+     * Relay mode: appends event of the mirrored game received from upstream.
+     */
+    void mirror_event(const char *event, size_t len) {
+        events.add_serialized(event, len);
+    }
 
-    void change_player(client_identity_t &identity, client_message &message);
-    void delete_player(client_identity_t &identity);
-    void add_new_player(client_identity_t &identity, client_message &message);
+    void change_player(slot_t slot, client_message &message);
+    void delete_player(slot_t slot);
+    void add_new_player(slot_t slot, client_message &message);
 
 private:
     void new_game(RandomGenerator &generator, server_params_t &params);
     void game_over();
 
     /*
-     * Moves given player by 1 in given direction.
+     * Removes worms listed in [died] keeping order of the rest.
      */
-    void make_move(client_identity_t identity);
+    void remove_dead_worms();
 
     void generate_new_game(server_params_t &params);
     void generate_pixel(player_number_t number, pixel_t pixel);
@@ -73,13 +136,23 @@ private:
 
 private:
     game_id_t game_id;
-    std::map<client_identity_t, worm_position_t, IdentityComparator> worm_position;
-    std::map<client_identity_t, Player, IdentityComparator> all_players;
-    std::map<player_name_t, client_identity_t> active_players;
+    uint64_t games_started;
+    std::vector<Player> players;
+    // Index of player's worm in [worms] or [NO_SLOT] if the player does not play.
+    std::vector<uint32_t> worm_index;
+    std::vector<uint8_t> key_pushed;
+    size_t keys_pushed;
+    // Transparent comparator finds names of decoded messages without copying them.
+    std::map<player_name_t, slot_t, std::less<>> active_players;
+    // Total length of active players' names with terminating zeros.
+    size_t names_bytes;
+    // Active players that did not negotiate wide events.
+    size_t legacy_players;
+    bool wide_game;
     EventCollection events;
-    std::set<pixel_t> eaten_pixels;
-    std::set<client_identity_t, IdentityComparator> players_key_pushed;
-    std::vector<client_identity_t> current_players;
+    PixelBoard eaten_pixels;
+    worms_t worms;
+    std::vector<size_t> died;
     game_phase phase;
 };
 
@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <cassert>
+
+#include "idle_wheel.h"
+
+namespace {
+    constexpr uint64_t NOT_SCHEDULED = UINT64_MAX;
+    constexpr uint64_t BUCKET_MASK = IDLE_WHEEL_BUCKETS - 1;
+
+    static_assert((IDLE_WHEEL_BUCKETS & BUCKET_MASK) == 0, "bucket count is a power of two");
+
+    uint64_t tick_of(uint64_t ns) {
+        return ns >> IDLE_WHEEL_TICK_SHIFT;
+    }
+}
+
+IdleWheel::IdleWheel(uint64_t timeout_ns) :
+        timeout_ticks((timeout_ns + (uint64_t(1) << IDLE_WHEEL_TICK_SHIFT) - 1) >>
+                      IDLE_WHEEL_TICK_SHIFT),
+        next_tick(0), scheduled(0), heads(IDLE_WHEEL_BUCKETS, NO_SLOT) {
+    // A deadline a full span ahead would share its bucket with the current tick.
+    assert(timeout_ticks < IDLE_WHEEL_BUCKETS);
+}
+
+void IdleWheel::start(uint64_t now_ns) {
+    next_tick = tick_of(now_ns);
+}
+
+void IdleWheel::link(slot_t slot, uint64_t tick) {
+    slot_t &head = heads[tick & BUCKET_MASK];
+    deadlines[slot] = tick;
+    prev[slot] = NO_SLOT;
+    next[slot] = head;
+    if (head != NO_SLOT)
+        prev[head] = slot;
+    head = slot;
+}
+
+void IdleWheel::unlink(slot_t slot) {
+    if (prev[slot] != NO_SLOT)
+        next[prev[slot]] = next[slot];
+    else
+        heads[deadlines[slot] & BUCKET_MASK] = next[slot];
+    if (next[slot] != NO_SLOT)
+        prev[next[slot]] = prev[slot];
+    deadlines[slot] = NOT_SCHEDULED;
+}
+
+void IdleWheel::touch(slot_t slot, uint64_t now_ns) {
+    if (slot >= deadlines.size()) {
+        deadlines.resize(slot + 1, NOT_SCHEDULED);
+        next.resize(slot + 1, NO_SLOT);
+        prev.resize(slot + 1, NO_SLOT);
+    }
+
+    // Slot expires once the whole tick of its deadline has passed.
+    uint64_t tick = tick_of(now_ns) + timeout_ticks;
+    if (deadlines[slot] == tick)
+        return;
+
+    if (deadlines[slot] == NOT_SCHEDULED)
+        ++scheduled;
+    else
+        unlink(slot);
+    link(slot, tick);
+}
+
+void IdleWheel::remove(slot_t slot) {
+    if (slot >= deadlines.size() || deadlines[slot] == NOT_SCHEDULED)
+        return;
+
+    unlink(slot);
+    --scheduled;
+}
+
+void IdleWheel::expire(uint64_t now_ns, std::vector<slot_t> &expired) {
+    uint64_t now_tick = tick_of(now_ns);
+    // After a long pause every bucket is visited once.
+    uint64_t first = std::max(next_tick, now_tick >= IDLE_WHEEL_BUCKETS ?
+                                         now_tick - IDLE_WHEEL_BUCKETS : 0);
+
+    for (uint64_t tick = first; tick < now_tick; ++tick) {
+        slot_t slot = heads[tick & BUCKET_MASK];
+        while (slot != NO_SLOT) {
+            slot_t following = next[slot];
+            // Deadlines of slots touched during the pause are in later turns of the wheel.
+            if (deadlines[slot] < now_tick) {
+                unlink(slot);
+                --scheduled;
+                expired.push_back(slot);
+            }
+            slot = following;
+        }
+    }
+
+    next_tick = std::max(next_tick, now_tick);
+}
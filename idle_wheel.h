@@ -0,0 +1,69 @@
+#ifndef SCREEN_WORMS_IDLE_WHEEL_H
+#define SCREEN_WORMS_IDLE_WHEEL_H
+
+#include <cstdint>
+#include <vector>
+
+#include "server_types.h"
+
+// Wheel tick is 2^24 ns, about 16.8 ms; the wheel spans about 4.3 s.
+#define IDLE_WHEEL_TICK_SHIFT   24
+#define IDLE_WHEEL_BUCKETS      256
+
+/*
+ * Hashed timing wheel of client expiry deadlines. Every scheduled slot is linked into
+ * the bucket of its deadline tick, so rescheduling a client is O(1), and expiring
+ * visits only buckets of ticks that passed. Slots expire at most one wheel tick after
+ * their deadline.
+ */
+class IdleWheel {
+public:
+    /*
+     * Clients expire after [timeout_ns] without being touched; the timeout has to be
+     * shorter than the wheel span.
+     */
+    explicit IdleWheel(uint64_t timeout_ns);
+
+    /*
+     * Sets current time; must be called before the other methods.
+     */
+    void start(uint64_t now_ns);
+
+    /*
+     * Schedules or reschedules expiry of [slot] to [now_ns] + timeout.
+     */
+    void touch(slot_t slot, uint64_t now_ns);
+
+    /*
+     * Removes [slot] from the wheel if it is scheduled.
+     */
+    void remove(slot_t slot);
+
+    /*
+     * Moves slots whose deadlines passed before [now_ns] to [expired].
+     */
+    void expire(uint64_t now_ns, std::vector<slot_t> &expired);
+
+    size_t size() const {
+        return scheduled;
+    }
+
+private:
+    void link(slot_t slot, uint64_t tick);
+
+    void unlink(slot_t slot);
+
+private:
+    uint64_t timeout_ticks;
+    // Buckets of ticks before [next_tick] were already expired.
+    uint64_t next_tick;
+    size_t scheduled;
+    // First slot of every bucket's list or [NO_SLOT].
+    std::vector<slot_t> heads;
+    // Indexed by slot; deadline tick is UINT64_MAX for slots not in the wheel.
+    std::vector<uint64_t> deadlines;
+    std::vector<slot_t> next;
+    std::vector<slot_t> prev;
+};
+
+#endif //SCREEN_WORMS_IDLE_WHEEL_H
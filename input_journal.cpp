@@ -0,0 +1,229 @@
+#include <fcntl.h>
+#include <fstream>
+#include <iterator>
+#include <unistd.h>
+
+#include "input_journal.h"
+#include "err.h"
+
+bool EventDigest::observe(game_id_t game_id, const EventCollection &events,
+                          event_digest_t &finished) {
+    bool new_game = false;
+    // Events are cleared only when a new game starts.
+    if (game_id != current.game_id || events.get_size() < current.events) {
+        finished = get_digest();
+        new_game = current.events > 0;
+        current = {game_id, 0, 0};
+        crc.reset();
+    }
+
+    crc.update(events.get_event_data(current.events),
+               events.get_bytes_between(current.events, events.get_size()));
+    current.events = events.get_size();
+    return new_game;
+}
+
+InputJournal::~InputJournal() {
+    if (is_open()) {
+        flush();
+        close(fd);
+    }
+}
+
+void InputJournal::open(const std::string &path, const server_params_t &params) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        syserr("cannot open journal %s", path.c_str());
+
+    rounds_per_second = params.rounds_per_second;
+    pending.insert(pending.end(), JOURNAL_MAGIC, JOURNAL_MAGIC + sizeof(JOURNAL_MAGIC) - 1);
+    append_number(params.generator_seed);
+    append_number(params.turning_speed);
+    append_number(params.rounds_per_second);
+    append_number(params.width);
+    append_number(params.height);
+    flush();
+}
+
+void InputJournal::append_number(uint64_t n) {
+    // Seven bits at a time, lowest first; the high bit marks that more bytes follow.
+    while (n >= 0x80) {
+        pending.push_back(char((n & 0x7F) | 0x80));
+        n >>= 7;
+    }
+    pending.push_back(char(n));
+}
+
+void InputJournal::append_pending_rounds() {
+    if (pending_rounds == 0)
+        return;
+
+    pending.push_back(JOURNAL_ROUNDS);
+    append_number(pending_rounds);
+    pending_rounds = 0;
+}
+
+void InputJournal::append_checkpoint(const event_digest_t &event_digest) {
+    pending.push_back(JOURNAL_CHECKPOINT);
+    append_number(event_digest.game_id);
+    append_number(event_digest.events);
+    append_number(event_digest.crc);
+}
+
+void InputJournal::append_player(journal_record type, slot_t slot, const client_message &message) {
+    append_pending_rounds();
+    pending.push_back(type);
+    append_number(slot);
+    append_number(message.session_id);
+    append_number(message.turn_direction |
+                  (message.wide_player_numbers ? WIDE_PLAYER_NUMBERS_FLAG : 0));
+    append_number(message.player_name.length);
+    pending.insert(pending.end(), message.player_name.bytes,
+                   message.player_name.bytes + message.player_name.length);
+}
+
+void InputJournal::add_player(slot_t slot, const client_message &message) {
+    if (is_open())
+        append_player(JOURNAL_ADD_PLAYER, slot, message);
+}
+
+void InputJournal::change_player(slot_t slot, const client_message &message) {
+    if (is_open())
+        append_player(JOURNAL_CHANGE_PLAYER, slot, message);
+}
+
+void InputJournal::pressed_key(slot_t slot, turn_direction_t turn_direction) {
+    if (!is_open())
+        return;
+
+    append_pending_rounds();
+    pending.push_back(JOURNAL_PRESSED_KEY);
+    append_number(slot);
+    append_number(turn_direction);
+}
+
+void InputJournal::delete_player(slot_t slot) {
+    if (!is_open())
+        return;
+
+    append_pending_rounds();
+    pending.push_back(JOURNAL_DELETE_PLAYER);
+    append_number(slot);
+}
+
+void InputJournal::round(game_id_t game_id, const EventCollection &events) {
+    if (!is_open())
+        return;
+
+    ++pending_rounds;
+    ++rounds_since_flush;
+    event_digest_t finished;
+    if (digest.observe(game_id, events, finished)) {
+        append_pending_rounds();
+        append_checkpoint(finished);
+    }
+
+    if (pending.size() >= JOURNAL_FLUSH_BYTES || rounds_since_flush >= rounds_per_second)
+        flush();
+}
+
+void InputJournal::flush() {
+    if (!is_open())
+        return;
+
+    append_pending_rounds();
+    event_digest_t current = digest.get_digest();
+    if (current.events > 0 && rounds_since_flush > 0)
+        append_checkpoint(current);
+    rounds_since_flush = 0;
+
+    size_t written = 0;
+    while (written < pending.size()) {
+        ssize_t len = write(fd, pending.data() + written, pending.size() - written);
+        if (len < 0) {
+            if (errno == EINTR)
+                continue;
+            syserr("write to journal");
+        }
+        written += len;
+    }
+    pending.clear();
+}
+
+JournalReader::JournalReader(const std::string &path) : position(0), params{} {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        fatal("cannot open journal %s", path.c_str());
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    size_t magic_length = sizeof(JOURNAL_MAGIC) - 1;
+    if (data.size() < magic_length || memcmp(data.data(), JOURNAL_MAGIC, magic_length) != 0)
+        fatal("%s is not a journal", path.c_str());
+    position = magic_length;
+
+    params.generator_seed = read_number();
+    params.turning_speed = read_number();
+    params.rounds_per_second = read_number();
+    params.width = read_number();
+    params.height = read_number();
+    if (params.generator_seed > UINT32_MAX || params.turning_speed < 1 ||
+        params.turning_speed > 90 || params.rounds_per_second < 1 ||
+        params.width < MIN_SCREEN_SIZE || params.width > MAX_SCREEN_SIZE ||
+        params.height < MIN_SCREEN_SIZE || params.height > MAX_SCREEN_SIZE) {
+        fatal("invalid game parameters in journal %s", path.c_str());
+    }
+}
+
+journal_record JournalReader::read_type() {
+    if (at_end())
+        fatal("journal is truncated");
+
+    uint8_t type = data[position++];
+    if (type > JOURNAL_CHECKPOINT)
+        fatal("unknown journal record %u", type);
+    return journal_record(type);
+}
+
+uint64_t JournalReader::read_number() {
+    uint64_t n = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (at_end())
+            fatal("journal is truncated");
+
+        uint8_t byte = data[position++];
+        n |= uint64_t(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return n;
+    }
+
+    fatal("invalid number in journal");
+    return 0;
+}
+
+void JournalReader::read_player(slot_t &slot, client_message &message) {
+    uint64_t player_slot = read_number();
+    message.session_id = read_number();
+    uint64_t flags = read_number();
+    uint64_t name_length = read_number();
+
+    message.wide_player_numbers = flags & WIDE_PLAYER_NUMBERS_FLAG;
+    message.turn_direction = flags & ~WIDE_PLAYER_NUMBERS_FLAG;
+    // Encoding of events sent to the client does not affect the game.
+    message.compact_events = false;
+    message.snapshots = false;
+    message.next_expected_event_no = 0;
+    if (player_slot >= NO_SLOT || flags > UINT8_MAX || message.turn_direction > LEFT ||
+        name_length > MAX_PLAYER_NAME_LENGTH || data.size() - position < name_length) {
+        fatal("invalid player record in journal");
+    }
+
+    slot = player_slot;
+    message.player_name.assign({data.data() + position, name_length});
+    position += name_length;
+}
+
+void JournalReader::read_checkpoint(event_digest_t &digest) {
+    digest.game_id = read_number();
+    digest.events = read_number();
+    digest.crc = read_number();
+}
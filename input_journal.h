@@ -0,0 +1,155 @@
+#ifndef SCREEN_WORMS_INPUT_JOURNAL_H
+#define SCREEN_WORMS_INPUT_JOURNAL_H
+
+#include <string>
+#include <vector>
+
+#include "client_message.h"
+#include "crc32.h"
+#include "event_collection.h"
+#include "server_types.h"
+
+// Pending records are written out when they reach this size or after a second of rounds.
+#define JOURNAL_FLUSH_BYTES     4096
+#define JOURNAL_MAGIC           "SWJ1"
+
+/*
+ * Journal starts with [JOURNAL_MAGIC] followed by game parameters: seed, turning speed,
+ * rounds per second, width and height. Then come records, each being a type byte
+ * followed by fields. All numbers are unsigned LEB128 varints:
+ *   JOURNAL_ROUNDS n                         [GameState::new_round] ran n times
+ *   JOURNAL_ADD_PLAYER slot session flags name_length name
+ *   JOURNAL_CHANGE_PLAYER slot session flags name_length name
+ *   JOURNAL_PRESSED_KEY slot turn_direction  only keys that changed the game are recorded
+ *   JOURNAL_DELETE_PLAYER slot
+ *   JOURNAL_CHECKPOINT game_id events crc    digest of events of a game so far
+ * Flags are the turn direction byte of the client message, wide flag included.
+ */
+enum journal_record {
+    JOURNAL_ROUNDS,
+    JOURNAL_ADD_PLAYER,
+    JOURNAL_CHANGE_PLAYER,
+    JOURNAL_PRESSED_KEY,
+    JOURNAL_DELETE_PLAYER,
+    JOURNAL_CHECKPOINT
+};
+
+struct event_digest_t {
+    game_id_t game_id;
+    size_t events;
+    uint32_t crc;
+};
+
+/*
+ * Running checksum of serialized events of the current game. Events are appended
+ * within a game, and all events of a game are observed before the next one starts.
+ */
+class EventDigest {
+public:
+    EventDigest() : current{0, 0, 0} {}
+
+    /*
+     * Checksums events added since the last call. Returns [true] if a new game started,
+     * in which case digest of the previous game is saved to [finished].
+     */
+    bool observe(game_id_t game_id, const EventCollection &events, event_digest_t &finished);
+
+    event_digest_t get_digest() const {
+        return {current.game_id, current.events, crc.get_value()};
+    }
+
+private:
+    event_digest_t current;
+    Crc32 crc;
+};
+
+/*
+ * Records inputs of [GameState] of a server, so that its games can be re-simulated
+ * offline. Methods of a journal that is not open do nothing.
+ */
+class InputJournal {
+public:
+    InputJournal() : fd(-1), pending_rounds(0), rounds_since_flush(0), rounds_per_second(0) {}
+    ~InputJournal();
+
+    InputJournal(const InputJournal &) = delete;
+    InputJournal &operator=(const InputJournal &) = delete;
+
+    /*
+     * Creates journal at [path] and writes parameters of the game to it.
+     */
+    void open(const std::string &path, const server_params_t &params);
+
+    bool is_open() const {
+        return fd >= 0;
+    }
+
+    void add_player(slot_t slot, const client_message &message);
+
+    void change_player(slot_t slot, const client_message &message);
+
+    void pressed_key(slot_t slot, turn_direction_t turn_direction);
+
+    void delete_player(slot_t slot);
+
+    /*
+     * Must be called after every [GameState::new_round] with its events.
+     */
+    void round(game_id_t game_id, const EventCollection &events);
+
+    void flush();
+
+private:
+    void append_number(uint64_t n);
+
+    void append_player(journal_record type, slot_t slot, const client_message &message);
+
+    void append_pending_rounds();
+
+    void append_checkpoint(const event_digest_t &digest);
+
+private:
+    int fd;
+    std::vector<char> pending;
+    uint64_t pending_rounds;
+    uint64_t rounds_since_flush;
+    uint64_t rounds_per_second;
+    EventDigest digest;
+};
+
+/*
+ * Reads journal written by [InputJournal]. Exits the program if the journal is invalid.
+ */
+class JournalReader {
+public:
+    explicit JournalReader(const std::string &path);
+
+    /*
+     * Parameters of the recorded game; networking parameters are left default.
+     */
+    const server_params_t &get_params() const {
+        return params;
+    }
+
+    bool at_end() const {
+        return position == data.size();
+    }
+
+    journal_record read_type();
+
+    uint64_t read_number();
+
+    /*
+     * Reads fields of JOURNAL_ADD_PLAYER and JOURNAL_CHANGE_PLAYER records.
+     */
+    void read_player(slot_t &slot, client_message &message);
+
+    void read_checkpoint(event_digest_t &digest);
+
+private:
+    std::vector<char> data;
+    size_t position;
+    server_params_t params;
+};
+
+#endif //SCREEN_WORMS_INPUT_JOURNAL_H
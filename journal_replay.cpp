@@ -0,0 +1,129 @@
+#include <chrono>
+#include <cstdio>
+#include <getopt.h>
+
+#include "game_state.h"
+#include "input_journal.h"
+#include "err.h"
+
+/*
+ * Re-simulates games recorded by a server started with -j. Inputs are applied to
+ * [GameState] between rounds exactly as the server applied them, with no sockets or
+ * timer, and digests of produced events are compared with checkpoints in the journal.
+ *
+ * Usage: journal-replay [-e file] journal
+ *   -e file  writes all produced events, serialized as they are sent, to file
+ */
+namespace {
+    struct replay_stats_t {
+        uint64_t rounds;
+        uint64_t games;
+        uint64_t events;
+        uint64_t checkpoints;
+    };
+
+    bool digests_equal(const event_digest_t &a, const event_digest_t &b) {
+        return a.game_id == b.game_id && a.events == b.events && a.crc == b.crc;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const char *events_path = nullptr;
+    int opt;
+    while ((opt = getopt(argc, argv, "e:")) != -1) {
+        switch (opt) {
+            case 'e':
+                events_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-e file] journal\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (optind + 1 != argc) {
+        fprintf(stderr, "Usage: %s [-e file] journal\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    JournalReader journal(argv[optind]);
+    server_params_t params = journal.get_params();
+    RandomGenerator generator(params.generator_seed);
+    GameState game_state;
+    EventDigest digest;
+    event_digest_t finished{0, 0, 0};
+    replay_stats_t stats{0, 0, 0, 0};
+
+    FILE *events_file = nullptr;
+    if (events_path != nullptr && (events_file = fopen(events_path, "wb")) == nullptr)
+        syserr("cannot open %s", events_path);
+    size_t written_events = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    while (!journal.at_end()) {
+        slot_t slot;
+        client_message message{};
+        event_digest_t checkpoint;
+
+        switch (journal.read_type()) {
+            case JOURNAL_ROUNDS:
+                for (uint64_t n = journal.read_number(); n > 0; --n) {
+                    auto &events = game_state.get_events();
+                    game_state.new_round(params, generator);
+                    ++stats.rounds;
+
+                    if (digest.observe(game_state.get_game_id(), events, finished)) {
+                        ++stats.games;
+                        stats.events += finished.events;
+                        written_events = 0;
+                    }
+                    if (events_file != nullptr) {
+                        fwrite(events.get_event_data(written_events), 1,
+                               events.get_bytes_between(written_events, events.get_size()),
+                               events_file);
+                        written_events = events.get_size();
+                    }
+                }
+                break;
+            case JOURNAL_ADD_PLAYER:
+                journal.read_player(slot, message);
+                game_state.add_new_player(slot, message);
+                break;
+            case JOURNAL_CHANGE_PLAYER:
+                journal.read_player(slot, message);
+                game_state.change_player(slot, message);
+                break;
+            case JOURNAL_PRESSED_KEY:
+                slot = journal.read_number();
+                game_state.change_pressed_key(slot, journal.read_number());
+                break;
+            case JOURNAL_DELETE_PLAYER:
+                game_state.delete_player(journal.read_number());
+                break;
+            case JOURNAL_CHECKPOINT:
+                journal.read_checkpoint(checkpoint);
+                // Checkpoint of a game that ended is written after the next game started.
+                if (!digests_equal(checkpoint, digest.get_digest()) &&
+                    !digests_equal(checkpoint, finished)) {
+                    fatal("events of game %u differ from the journal after round %lu",
+                          checkpoint.game_id, stats.rounds);
+                }
+                ++stats.checkpoints;
+                break;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                                   start).count();
+
+    if (events_file != nullptr)
+        fclose(events_file);
+
+    event_digest_t last = digest.get_digest();
+    stats.games += last.events > 0;
+    stats.events += last.events;
+    printf("rounds %lu, games %lu, events %lu, checkpoints matched %lu\n", stats.rounds,
+           stats.games, stats.events, stats.checkpoints);
+    printf("replayed in %.3f s, %.0f rounds/s, %.0f events/s\n", seconds,
+           stats.rounds / seconds, stats.events / seconds);
+
+    return 0;
+}
@@ -0,0 +1,522 @@
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdio>
+#include <getopt.h>
+#include <netdb.h>
+#include <poll.h>
+#include <string>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+#include "board_snapshot.h"
+#include "compact_events.h"
+#include "crc32.h"
+#include "event.h"
+#include "err.h"
+
+/*
+ * Emulates a swarm of clients of a running server on its own sockets. Every client
+ * sends its message every interval with its own session id and name, presses arrows
+ * so that games keep starting and follows event numbers like a real client.
+ * Spectators send empty names; late joiners start after a delay. Checksums of all
+ * received events are validated. With -c clients ask for compact datagrams, which
+ * are decoded back to legacy events. With -S clients accept board snapshots and skip
+ * events up to the watermark once all parts of one arrived.
+ *
+ * Reported are latency from a request of a catching up client to the reply starting
+ * with the requested event, delivery lag of every event behind the first client that
+ * received it, traffic in both directions, events lost on the way, inferred from
+ * gaps in event numbers, and time and bytes late joiners needed to get in sync with
+ * the swarm, that is to expect the next event any client received.
+ *
+ * Usage: load-gen [-a address] [-p port] [-n players] [-s spectators] [-l late joiners]
+ *                 [-L late join delay s] [-d duration s] [-i interval ms] [-w] [-c] [-S]
+ */
+namespace {
+    struct options_t {
+        std::string address = "::1";
+        std::string port = "2021";
+        size_t players = 10;
+        size_t spectators = 0;
+        size_t late_joiners = 0;
+        uint64_t late_join_delay_s = 5;
+        uint64_t duration_s = 10;
+        uint64_t interval_ms = 30;
+        bool wide = false;
+        bool compact = false;
+        bool snapshots = false;
+    };
+
+    struct client_t {
+        int sock;
+        session_id_t session_id;
+        std::string name;
+        uint64_t start_ns;
+        uint64_t next_send_ns;
+        uint64_t next_key_ns;
+        turn_direction_t key;
+        bool in_game;
+        game_id_t game_id;
+        event_no_t next_expected;
+        // Highest event number of the current game received so far, plus one.
+        event_no_t seen_up_to;
+        // Request that should be answered with event [requested] sent at [requested_ns].
+        bool request_pending;
+        event_no_t requested;
+        uint64_t requested_ns;
+        // Parts of the snapshot with watermark [snapshot_watermark] that arrived.
+        event_no_t snapshot_watermark;
+        std::vector<bool> snapshot_parts;
+        size_t snapshot_parts_left;
+        bool late;
+        bool synced;
+        uint64_t bytes_received;
+    };
+
+    struct traffic_stats_t {
+        uint64_t datagrams_sent;
+        uint64_t bytes_sent;
+        uint64_t datagrams_received;
+        uint64_t bytes_received;
+        uint64_t events;
+        uint64_t duplicate_events;
+        uint64_t lost_events;
+        uint64_t bad_crc;
+        uint64_t malformed;
+        uint64_t games;
+        uint64_t snapshot_parts;
+        uint64_t snapshots;
+    };
+
+    uint64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    template<typename T>
+    T read_number(const char *data) {
+        T n;
+        memcpy(&n, data, sizeof(n));
+        switch (sizeof(n)) {
+            case 4:
+                return be32toh(n);
+            default:
+                return n;
+        }
+    }
+
+    class LoadGenerator {
+    public:
+        LoadGenerator(const options_t &options) : options(options), stats{}, random(1) {}
+
+        void run();
+
+    private:
+        void connect_clients();
+
+        void send_message(client_t &client, uint64_t now);
+
+        void receive(client_t &client, uint64_t now);
+
+        void handle_datagram(client_t &client, const char *data, size_t len, uint64_t now);
+
+        void handle_snapshot_part(client_t &client, const char *data, size_t len);
+
+        /*
+         * Marks late joiner [client] as synced once it expects the next event that any
+         * client received.
+         */
+        void check_synced(client_t &client, uint64_t now);
+
+        void report(double seconds);
+
+        uint32_t next_random() {
+            random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+            return random >> 33;
+        }
+
+    private:
+        options_t options;
+        std::vector<client_t> clients;
+        traffic_stats_t stats;
+        uint64_t random;
+        std::vector<uint64_t> latencies_ns;
+        std::vector<uint64_t> lags_ns;
+        std::vector<uint64_t> sync_ns;
+        std::vector<uint64_t> sync_bytes;
+        // Time the first client received every event, by game.
+        std::unordered_map<game_id_t, std::vector<uint64_t>> first_received;
+        CompactDecoder decoder;
+        // Legacy events decoded from the last compact datagram.
+        std::vector<char> decoded;
+        snapshot_part_t part;
+    };
+
+    void LoadGenerator::connect_clients() {
+        struct addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        struct addrinfo *address;
+        if (getaddrinfo(options.address.c_str(), options.port.c_str(), &hints, &address) != 0)
+            fatal("cannot resolve %s", options.address.c_str());
+
+        uint64_t start = now_ns();
+        size_t total = options.players + options.spectators + options.late_joiners;
+        for (size_t i = 0; i < total; ++i) {
+            client_t client{};
+            client.sock = socket(address->ai_family, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+            if (client.sock < 0)
+                syserr("socket");
+            // Connected socket receives datagrams of the server only.
+            if (connect(client.sock, address->ai_addr, address->ai_addrlen) < 0)
+                syserr("connect");
+
+            client.session_id = start / 1000 + i;
+            bool spectator = i >= options.players && i < options.players + options.spectators;
+            if (!spectator)
+                client.name = "lg" + std::to_string(i);
+            client.start_ns = start;
+            if (i >= options.players + options.spectators) {
+                client.start_ns += options.late_join_delay_s * 1000000000ULL;
+                client.late = true;
+            }
+            // Clients are spread over the interval.
+            client.next_send_ns = client.start_ns +
+                                  options.interval_ms * 1000000ULL * i / std::max<size_t>(total, 1);
+            client.next_key_ns = client.next_send_ns;
+            client.key = LEFT;
+            clients.push_back(client);
+        }
+
+        freeaddrinfo(address);
+    }
+
+    void LoadGenerator::send_message(client_t &client, uint64_t now) {
+        // Keys change about every second; straight only while a game is running.
+        if (now >= client.next_key_ns) {
+            uint32_t r = next_random();
+            client.key = r % 4 == 0 && client.in_game ? STRAIGHT : r % 2 == 0 ? LEFT : RIGHT;
+            client.next_key_ns = now + 500000000ULL + r % 1000000000ULL;
+        }
+
+        char message[CLIENT_MESSAGE_HEADER_LENGTH + MAX_PLAYER_NAME_LENGTH];
+        uint64_t session_id = htobe64(client.session_id);
+        uint8_t turn = client.key | (options.wide ? WIDE_PLAYER_NUMBERS_FLAG : 0) |
+                       (options.compact ? COMPACT_EVENTS_FLAG : 0) |
+                       (options.snapshots ? SNAPSHOT_FLAG : 0);
+        uint32_t next_expected = htobe32(client.next_expected);
+        memcpy(message, &session_id, sizeof(session_id));
+        memcpy(message + 8, &turn, sizeof(turn));
+        memcpy(message + 9, &next_expected, sizeof(next_expected));
+        memcpy(message + CLIENT_MESSAGE_HEADER_LENGTH, client.name.data(), client.name.size());
+        size_t len = CLIENT_MESSAGE_HEADER_LENGTH + client.name.size();
+
+        if (send(client.sock, message, len, 0) == ssize_t(len)) {
+            ++stats.datagrams_sent;
+            stats.bytes_sent += len;
+            // Requests of clients catching up, after joining or after a loss, are answered.
+            if (!client.request_pending &&
+                (client.game_id == 0 || client.next_expected < client.seen_up_to)) {
+                client.request_pending = true;
+                client.requested = client.next_expected;
+                client.requested_ns = now;
+            }
+        }
+    }
+
+    void LoadGenerator::handle_datagram(client_t &client, const char *data, size_t len,
+                                        uint64_t now) {
+        if (len < sizeof(game_id_t)) {
+            ++stats.malformed;
+            return;
+        }
+        game_id_t game_id = read_number<game_id_t>(data);
+        size_t position = sizeof(game_id_t);
+        bool first_event = true;
+
+        while (position < len) {
+            if (len - position < EVENT_OVERHEAD) {
+                ++stats.malformed;
+                return;
+            }
+            event_len_t event_len = read_number<event_len_t>(data + position);
+            size_t total = sizeof(event_len_t) + event_len + sizeof(crc32_t);
+            if (event_len < sizeof(event_no_t) + sizeof(event_type_t) || len - position < total) {
+                ++stats.malformed;
+                return;
+            }
+            uint32_t crc = read_number<crc32_t>(data + position + total - sizeof(crc32_t));
+            if (compute_crc32(data + position, total - sizeof(crc32_t)) != crc) {
+                ++stats.bad_crc;
+                return;
+            }
+
+            event_no_t event_no = read_number<event_no_t>(data + position + sizeof(event_len_t));
+            uint8_t type = data[position + sizeof(event_len_t) + sizeof(event_no_t)];
+            position += total;
+
+            // Events of a new game start from its first event.
+            if (game_id != client.game_id) {
+                if (event_no != 0 || (type != NEW_GAME && type != WIDE_NEW_GAME))
+                    continue;
+                client.game_id = game_id;
+                client.in_game = true;
+                client.next_expected = 0;
+                client.seen_up_to = 0;
+                client.request_pending = client.request_pending && client.requested == 0;
+            }
+
+            auto &received = first_received[game_id];
+            if (received.size() <= event_no)
+                received.resize(event_no + 1, 0);
+
+            // Reply starts with the requested event. Event that did not exist when it was
+            // requested came with a broadcast.
+            if (first_event && client.request_pending && event_no == client.requested) {
+                if (received[event_no] != 0 && received[event_no] < client.requested_ns)
+                    latencies_ns.push_back(now - client.requested_ns);
+                client.request_pending = false;
+            }
+            first_event = false;
+
+            if (event_no >= client.seen_up_to) {
+                stats.lost_events += event_no - client.seen_up_to;
+                client.seen_up_to = event_no + 1;
+            }
+            if (event_no != client.next_expected) {
+                if (event_no < client.next_expected)
+                    ++stats.duplicate_events;
+                continue;
+            }
+
+            ++client.next_expected;
+            ++stats.events;
+            if (type == GAME_OVER)
+                client.in_game = false;
+
+            if (received[event_no] == 0) {
+                received[event_no] = now;
+                if (event_no == 0)
+                    ++stats.games;
+            }
+            else {
+                lags_ns.push_back(now - received[event_no]);
+            }
+        }
+    }
+
+    void LoadGenerator::handle_snapshot_part(client_t &client, const char *data, size_t len) {
+        if (!verify_snapshot_part(data, len)) {
+            ++stats.bad_crc;
+            return;
+        }
+        if (!decode_snapshot_part(data, len, part)) {
+            ++stats.malformed;
+            return;
+        }
+        ++stats.snapshot_parts;
+        // Snapshot follows events announcing its game.
+        if (part.game_id != client.game_id)
+            return;
+
+        if (part.watermark != client.snapshot_watermark ||
+            part.parts != client.snapshot_parts.size()) {
+            client.snapshot_watermark = part.watermark;
+            client.snapshot_parts.assign(part.parts, false);
+            client.snapshot_parts_left = part.parts;
+        }
+        if (client.snapshot_parts[part.part])
+            return;
+        client.snapshot_parts[part.part] = true;
+        --client.snapshot_parts_left;
+        // Events up to the watermark are not expected to come as events.
+        client.seen_up_to = std::max(client.seen_up_to, part.watermark);
+
+        if (client.snapshot_parts_left == 0 && client.next_expected >= part.header_events &&
+            client.next_expected < part.watermark) {
+            client.next_expected = part.watermark;
+            ++stats.snapshots;
+        }
+    }
+
+    void LoadGenerator::check_synced(client_t &client, uint64_t now) {
+        if (!client.late || client.synced || client.game_id == 0)
+            return;
+
+        if (client.next_expected >= first_received[client.game_id].size()) {
+            client.synced = true;
+            sync_ns.push_back(now - client.start_ns);
+            sync_bytes.push_back(client.bytes_received);
+        }
+    }
+
+    void LoadGenerator::receive(client_t &client, uint64_t now) {
+        char buf[DATAGRAM_SIZE + 1];
+        while (true) {
+            ssize_t len = recv(client.sock, buf, sizeof(buf), 0);
+            if (len < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED)
+                    syserr("recv");
+                return;
+            }
+            ++stats.datagrams_received;
+            stats.bytes_received += len;
+            client.bytes_received += len;
+            if (options.snapshots && is_snapshot_part(buf, len))
+                handle_snapshot_part(client, buf, len);
+            else if (!options.compact)
+                handle_datagram(client, buf, len, now);
+            else if (!CompactDecoder::verify(buf, len))
+                ++stats.bad_crc;
+            else if (!decoder.decode(buf, len, decoded))
+                ++stats.malformed;
+            else
+                handle_datagram(client, decoded.data(), decoded.size(), now);
+            check_synced(client, now);
+        }
+    }
+
+    void LoadGenerator::run() {
+        connect_clients();
+
+        std::vector<struct pollfd> poll_fds(clients.size());
+        for (size_t i = 0; i < clients.size(); ++i)
+            poll_fds[i] = {clients[i].sock, POLLIN, 0};
+
+        uint64_t start = now_ns();
+        uint64_t end = start + options.duration_s * 1000000000ULL;
+        uint64_t interval = options.interval_ms * 1000000ULL;
+        uint64_t now = start;
+        while (now < end) {
+            uint64_t next_send = end;
+            for (auto &client : clients) {
+                if (now >= client.next_send_ns) {
+                    send_message(client, now);
+                    client.next_send_ns += interval;
+                    // Client that fell behind does not send a burst.
+                    if (client.next_send_ns < now)
+                        client.next_send_ns = now + interval;
+                }
+                next_send = std::min(next_send, client.next_send_ns);
+            }
+
+            int timeout_ms = int((next_send - std::min(next_send, now_ns())) / 1000000);
+            if (poll(poll_fds.data(), poll_fds.size(), timeout_ms) < 0 && errno != EINTR)
+                syserr("poll");
+
+            now = now_ns();
+            for (size_t i = 0; i < clients.size(); ++i) {
+                if (poll_fds[i].revents & POLLIN)
+                    receive(clients[i], now);
+            }
+        }
+
+        report(double(now - start) / 1e9);
+        for (auto &client : clients)
+            close(client.sock);
+    }
+
+    std::string percentiles(std::vector<uint64_t> &samples) {
+        if (samples.empty())
+            return "none";
+
+        std::sort(samples.begin(), samples.end());
+        std::string result;
+        const double points[] = {50, 90, 99, 99.9, 100};
+        const char *names[] = {"p50", "p90", "p99", "p99.9", "max"};
+        for (size_t i = 0; i < 5; ++i) {
+            size_t index = std::min(samples.size() - 1, size_t(points[i] / 100 * samples.size()));
+            char text[64];
+            snprintf(text, sizeof(text), "%s%s %.3f ms", i == 0 ? "" : ", ", names[i],
+                     samples[index] / 1e6);
+            result += text;
+        }
+        return result + " (" + std::to_string(samples.size()) + " samples)";
+    }
+
+    void LoadGenerator::report(double seconds) {
+        printf("clients: %zu players, %zu spectators, %zu late joiners, %.1f s\n",
+               options.players, options.spectators, options.late_joiners, seconds);
+        printf("sent: %.0f datagrams/s, %.0f bytes/s\n", stats.datagrams_sent / seconds,
+               stats.bytes_sent / seconds);
+        printf("received: %.0f datagrams/s, %.0f bytes/s, %.0f events/s\n",
+               stats.datagrams_received / seconds, stats.bytes_received / seconds,
+               stats.events / seconds);
+        printf("games: %lu, lost events: %lu, duplicate events: %lu, bad crc: %lu, "
+               "malformed: %lu\n", stats.games, stats.lost_events, stats.duplicate_events,
+               stats.bad_crc, stats.malformed);
+        printf("request latency: %s\n", percentiles(latencies_ns).c_str());
+        printf("delivery lag: %s\n", percentiles(lags_ns).c_str());
+        if (options.late_joiners > 0) {
+            uint64_t bytes = 0, max_bytes = 0;
+            for (uint64_t b : sync_bytes) {
+                bytes += b;
+                max_bytes = std::max(max_bytes, b);
+            }
+            printf("join to synced: %s\n", percentiles(sync_ns).c_str());
+            printf("bytes until synced: mean %.0f, max %lu; snapshots: %lu, parts: %lu\n",
+                   sync_bytes.empty() ? 0.0 : double(bytes) / sync_bytes.size(), max_bytes,
+                   stats.snapshots, stats.snapshot_parts);
+        }
+    }
+
+    void parse_options(options_t &options, int argc, char *argv[]) {
+        int opt;
+        while ((opt = getopt(argc, argv, "a:p:n:s:l:L:d:i:wcS")) != -1) {
+            switch (opt) {
+                case 'a':
+                    options.address = optarg;
+                    break;
+                case 'p':
+                    options.port = optarg;
+                    break;
+                case 'n':
+                    options.players = strtoul(optarg, nullptr, 10);
+                    break;
+                case 's':
+                    options.spectators = strtoul(optarg, nullptr, 10);
+                    break;
+                case 'l':
+                    options.late_joiners = strtoul(optarg, nullptr, 10);
+                    break;
+                case 'L':
+                    options.late_join_delay_s = strtoul(optarg, nullptr, 10);
+                    break;
+                case 'd':
+                    options.duration_s = strtoul(optarg, nullptr, 10);
+                    break;
+                case 'i':
+                    options.interval_ms = strtoul(optarg, nullptr, 10);
+                    if (options.interval_ms == 0)
+                        exit(EXIT_FAILURE);
+                    break;
+                case 'w':
+                    options.wide = true;
+                    break;
+                case 'c':
+                    options.compact = true;
+                    break;
+                case 'S':
+                    options.snapshots = true;
+                    break;
+                default:
+                    fprintf(stderr, "Usage: %s [-a address] [-p port] [-n players] [-s spectators] "
+                                    "[-l late joiners] [-L delay s] [-d duration s] "
+                                    "[-i interval ms] [-w] [-c] [-S]\n", argv[0]);
+                    exit(EXIT_FAILURE);
+            }
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    options_t options;
+    parse_options(options, argc, argv);
+
+    LoadGenerator generator(options);
+    generator.run();
+
+    return 0;
+}
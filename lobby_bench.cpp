@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdio>
+
+#include "game_state.h"
+#include "session_table.h"
+
+/*
+ * Measures admission cost and round time of [GameState] as the number of players
+ * grows. Every player negotiates wide events, so lobbies of any size can play.
+ */
+namespace {
+    constexpr size_t MEASURED_ROUNDS = 200;
+
+    double elapsed_ns(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() -
+                                                        start).count();
+    }
+}
+
+int main() {
+    printf("players,admission_ns_per_player,rounds,tick_us,ns_per_worm_step,events_per_round\n");
+    for (size_t count = 16; count <= 16384; count *= 4) {
+        server_params_t params{};
+        params.width = MAX_SCREEN_SIZE;
+        params.height = MAX_SCREEN_SIZE;
+        params.turning_speed = 6;
+        params.rounds_per_second = 50;
+        RandomGenerator generator(1);
+        GameState game_state;
+        SessionTable sessions;
+        std::vector<slot_t> slots;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            client_identity_t identity{};
+            memcpy(identity.first.s6_addr, &i, sizeof(i));
+            identity.second = htons(i % UINT16_MAX);
+
+            client_message message{};
+            message.session_id = i;
+            message.turn_direction = i % 2 == 0 ? LEFT : RIGHT;
+            message.wide_player_numbers = true;
+            message.player_name.assign("player" + std::to_string(i));
+            if (sessions.find(identity) == NO_SLOT && game_state.may_join(message)) {
+                slots.push_back(sessions.insert(identity));
+                game_state.add_new_player(slots.back(), message);
+            }
+        }
+        double admission = elapsed_ns(start) / count;
+
+        // Starts the game; then most worms go straight, so they do not run into their own trails.
+        game_state.new_round(params, generator);
+        game_state.get_events().all_broadcasted();
+        for (size_t i = 0; i < slots.size(); ++i) {
+            if (i % 4 != 0)
+                game_state.change_pressed_key(slots[i], STRAIGHT);
+        }
+
+        size_t rounds = 0;
+        size_t worm_steps = 0;
+        size_t events = 0;
+        double total = 0;
+        while (rounds < MEASURED_ROUNDS && game_state.in_game()) {
+            auto &collection = game_state.get_events();
+            size_t events_before = collection.get_size();
+            size_t alive = game_state.get_worm_count();
+
+            start = std::chrono::steady_clock::now();
+            game_state.new_round(params, generator);
+            total += elapsed_ns(start);
+
+            ++rounds;
+            worm_steps += alive;
+            events += collection.get_size() - events_before;
+            collection.all_broadcasted();
+        }
+
+        printf("%zu,%.1f,%zu,%.2f,%.2f,%.1f\n", count, admission, rounds, total / rounds / 1000.0,
+               total / worm_steps, double(events) / rounds);
+    }
+
+    return 0;
+}
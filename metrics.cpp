@@ -0,0 +1,286 @@
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "metrics.h"
+#include "err.h"
+
+namespace {
+    template<typename Metric>
+    struct family_t {
+        const char *name;
+        const char *help;
+        Metric server_metrics_t::*metric;
+    };
+
+    const family_t<MetricCounter> COUNTERS[] = {
+        {"received_datagrams_total", "Datagrams received from clients.",
+         &server_metrics_t::received_datagrams},
+        {"received_bytes_total", "Bytes of datagrams received from clients.",
+         &server_metrics_t::received_bytes},
+        {"received_wakeups_total", "Wakeups of the receive path that drained the socket.",
+         &server_metrics_t::received_wakeups},
+        {"invalid_datagrams_total", "Received datagrams that were rejected.",
+         &server_metrics_t::invalid_datagrams},
+        {"dropped_inputs_total", "Decoded datagrams dropped on a full input ring.",
+         &server_metrics_t::dropped_inputs},
+        {"dropped_requests_total", "Event requests dropped on a full sender queue.",
+         &server_metrics_t::dropped_requests},
+        {"sent_datagrams_total", "Datagrams handed to the kernel.",
+         &server_metrics_t::sent_datagrams},
+        {"sent_bytes_total", "Bytes of datagrams handed to the kernel.",
+         &server_metrics_t::sent_bytes},
+        {"send_failures_total", "Send calls that failed, mostly on a full socket buffer.",
+         &server_metrics_t::send_failures},
+        {"gso_saved_sends_total", "Datagrams that did not need a message thanks to UDP GSO.",
+         &server_metrics_t::gso_saved_sends},
+        {"gso_bytes_total", "Bytes of datagrams sent in UDP GSO messages.",
+         &server_metrics_t::gso_bytes},
+        {"catch_up_suppressed_bytes_total", "Catch-up bytes not sent as already in flight.",
+         &server_metrics_t::catch_up_suppressed_bytes},
+        {"catch_up_paced_bytes_total", "Catch-up bytes sent by the pacer.",
+         &server_metrics_t::catch_up_paced_bytes},
+        {"snapshot_datagrams_total", "Board snapshot parts sent instead of events.",
+         &server_metrics_t::snapshot_parts},
+        {"ticks_total", "Rounds run.", &server_metrics_t::ticks},
+        {"missed_ticks_total", "Rounds run late to catch up.", &server_metrics_t::missed_ticks},
+        {"dropped_ticks_total", "Rounds skipped over the catch-up cap.",
+         &server_metrics_t::dropped_ticks},
+        {"games_total", "Games started.", &server_metrics_t::games},
+        {"snapshots_total", "Board snapshots built.", &server_metrics_t::snapshots},
+        {"events_total", "Events generated.", &server_metrics_t::events},
+        {"upstream_events_total", "Events mirrored from upstream by a relay.",
+         &server_metrics_t::upstream_events},
+    };
+
+    const family_t<MetricGauge> GAUGES[] = {
+        {"waiting_messages", "Datagrams waiting for the socket to become writable.",
+         &server_metrics_t::waiting_messages},
+        {"payload_bytes", "Bytes of outbound payloads that are still referenced.",
+         &server_metrics_t::payload_bytes},
+        {"deferred_sender_commands", "Sender commands waiting for room in a full sender queue.",
+         &server_metrics_t::deferred_commands},
+        {"players", "Connected clients with a player name.", &server_metrics_t::players},
+        {"spectators", "Connected clients without a player name.",
+         &server_metrics_t::spectators},
+        {"worms", "Worms alive in the current game.", &server_metrics_t::worms},
+        {"game_events", "Events of the current game.", &server_metrics_t::game_events},
+        {"upstream_events_behind", "Events known to exist upstream but not mirrored yet.",
+         &server_metrics_t::upstream_events_behind},
+    };
+
+    // Gauges kept in nanoseconds.
+    const family_t<MetricGauge> DURATION_GAUGES[] = {
+        {"upstream_lag_seconds", "Time since the oldest event not mirrored from upstream "
+         "was known to exist.", &server_metrics_t::upstream_lag_ns},
+    };
+
+    const family_t<LatencyHistogram> HISTOGRAMS[] = {
+        {"check_timeout_seconds", "Time spent expiring idle clients per tick.",
+         &server_metrics_t::check_timeout_ns},
+        {"new_round_seconds", "Time spent simulating a round per tick.",
+         &server_metrics_t::new_round_ns},
+        {"snapshot_step_seconds", "Time spent following events and building board "
+         "snapshots per tick.", &server_metrics_t::snapshot_ns},
+        {"broadcast_seconds", "Time spent broadcasting events per tick.",
+         &server_metrics_t::broadcast_ns},
+        {"tick_seconds", "Duration of whole ticks.", &server_metrics_t::tick_ns},
+        {"tick_lateness_seconds", "Time ticks started behind their deadlines.",
+         &server_metrics_t::tick_lateness_ns},
+        {"tick_overrun_seconds", "Time ticks ran over the round period, for ticks that did.",
+         &server_metrics_t::tick_overrun_ns},
+        {"upstream_request_seconds", "Time from a relay's request for an existing event "
+         "to its arrival.", &server_metrics_t::upstream_request_ns},
+        {"upstream_delay_seconds", "Time datagrams with new events from upstream waited "
+         "for a relay.", &server_metrics_t::upstream_delay_ns},
+    };
+
+    const family_t<CountHistogram> COUNT_HISTOGRAMS[] = {
+        {"drained_per_wakeup", "Datagrams drained from the socket per wakeup of the "
+         "receive path.", &server_metrics_t::drained_per_wakeup},
+    };
+
+    void append_header(std::string &out, const char *name, const char *help, const char *type) {
+        out += "# HELP screen_worms_";
+        out += name;
+        out += " ";
+        out += help;
+        out += "\n# TYPE screen_worms_";
+        out += name;
+        out += " ";
+        out += type;
+        out += "\n";
+    }
+
+    void append_sample(std::string &out, const char *name, const char *suffix, int port,
+                       const char *le, const char *value) {
+        char line[256];
+        snprintf(line, sizeof(line), "screen_worms_%s%s{arena=\"%d\"%s%s%s} %s\n", name, suffix,
+                 port, le[0] != '\0' ? ",le=\"" : "", le, le[0] != '\0' ? "\"" : "", value);
+        out += line;
+    }
+
+    void append_sample(std::string &out, const char *name, const char *suffix, int port,
+                       const char *le, uint64_t value) {
+        append_sample(out, name, suffix, port, le, std::to_string(value).c_str());
+    }
+}
+
+void MetricsExporter::add_server(int port, const server_metrics_t &metrics) {
+    servers.emplace_back(port, &metrics);
+}
+
+void MetricsExporter::start(const std::string &path) {
+    struct sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path))
+        fatal("metrics socket path is too long: %s", path.c_str());
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+        syserr("socket");
+    // Socket left by a previous run would make bind fail; other files are kept.
+    struct stat existing;
+    if (lstat(path.c_str(), &existing) == 0) {
+        if (!S_ISSOCK(existing.st_mode))
+            fatal("metrics socket path exists and is not a socket: %s", path.c_str());
+        if (unlink(path.c_str()) < 0)
+            syserr("unlink %s", path.c_str());
+    }
+    else if (errno != ENOENT) {
+        syserr("lstat %s", path.c_str());
+    }
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+        syserr("bind %s", path.c_str());
+    if (listen(listen_fd, 16) < 0)
+        syserr("listen");
+
+    std::thread(&MetricsExporter::serve, this).detach();
+}
+
+std::string MetricsExporter::format() const {
+    std::string out;
+    for (const auto &family : COUNTERS) {
+        append_header(out, family.name, family.help, "counter");
+        for (const auto &[port, metrics] : servers)
+            append_sample(out, family.name, "", port, "", (metrics->*family.metric).get());
+    }
+
+    for (const auto &family : GAUGES) {
+        append_header(out, family.name, family.help, "gauge");
+        for (const auto &[port, metrics] : servers)
+            append_sample(out, family.name, "", port, "", (metrics->*family.metric).get());
+    }
+
+    for (const auto &family : DURATION_GAUGES) {
+        append_header(out, family.name, family.help, "gauge");
+        for (const auto &[port, metrics] : servers) {
+            char value[32];
+            snprintf(value, sizeof(value), "%.9f", (metrics->*family.metric).get() / 1e9);
+            append_sample(out, family.name, "", port, "", value);
+        }
+    }
+
+    for (const auto &family : HISTOGRAMS) {
+        append_header(out, family.name, family.help, "histogram");
+        for (const auto &[port, metrics] : servers) {
+            const LatencyHistogram &histogram = metrics->*family.metric;
+            // Sum of snapshotted buckets is the count, so +Inf bucket always matches it.
+            uint64_t cumulative = 0;
+            char le[32];
+            for (size_t b = 0; b < LATENCY_BUCKETS; ++b) {
+                cumulative += histogram.get_bucket(b);
+                if (b < LATENCY_BUCKETS - 1)
+                    snprintf(le, sizeof(le), "%g", LATENCY_BOUNDS_NS[b] / 1e9);
+                else
+                    snprintf(le, sizeof(le), "+Inf");
+                append_sample(out, family.name, "_bucket", port, le, cumulative);
+            }
+
+            char sum[32];
+            snprintf(sum, sizeof(sum), "%.9f", histogram.get_sum_ns() / 1e9);
+            append_sample(out, family.name, "_sum", port, "", sum);
+            append_sample(out, family.name, "_count", port, "", cumulative);
+        }
+    }
+
+    for (const auto &family : COUNT_HISTOGRAMS) {
+        append_header(out, family.name, family.help, "histogram");
+        for (const auto &[port, metrics] : servers) {
+            const CountHistogram &histogram = metrics->*family.metric;
+            uint64_t cumulative = 0;
+            for (size_t b = 0; b < COUNT_BUCKETS; ++b) {
+                cumulative += histogram.get_bucket(b);
+                std::string le = b < COUNT_BUCKETS - 1 ? std::to_string(COUNT_BOUNDS[b]) : "+Inf";
+                append_sample(out, family.name, "_bucket", port, le.c_str(), cumulative);
+            }
+
+            append_sample(out, family.name, "_sum", port, "", histogram.get_sum());
+            append_sample(out, family.name, "_count", port, "", cumulative);
+        }
+    }
+
+    return out;
+}
+
+[[noreturn]] void MetricsExporter::serve() {
+    // Error of the failing accept streak, reported once.
+    int failing = 0;
+    while (true) {
+        int fd = accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            // Scrapes are not worth the server; resources may come back later.
+            if (errno != failing)
+                fprintf(stderr, "metrics: accept: %s\n", strerror(errno));
+            failing = errno;
+            std::this_thread::sleep_for(std::chrono::milliseconds(METRICS_ACCEPT_BACKOFF_MS));
+            continue;
+        }
+
+        failing = 0;
+        answer(fd);
+        close(fd);
+    }
+}
+
+void MetricsExporter::answer(int fd) const {
+    // Request of an HTTP scraper is read and ignored; plain readers send nothing.
+    struct pollfd request{fd, POLLIN, 0};
+    if (poll(&request, 1, METRICS_REQUEST_TIMEOUT_MS) > 0) {
+        char discarded[1024];
+        ssize_t ignored = recv(fd, discarded, sizeof(discarded), MSG_DONTWAIT);
+        (void)ignored;
+    }
+
+    std::string body = format();
+    std::string response = "HTTP/1.0 200 OK\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    // Scraper that does not read cannot hold the exporter for longer than the timeout.
+    struct timeval timeout{METRICS_SEND_TIMEOUT_MS / 1000, METRICS_SEND_TIMEOUT_MS % 1000 * 1000};
+    if (setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout)) < 0)
+        return;
+
+    size_t written = 0;
+    while (written < response.size()) {
+        ssize_t len = send(fd, response.data() + written, response.size() - written,
+                           MSG_NOSIGNAL);
+        if (len < 0 && errno == EINTR)
+            continue;
+        // Scraper went away or the timeout expired.
+        if (len <= 0 || size_t(len) < response.size() - written)
+            return;
+        written += len;
+    }
+}
@@ -0,0 +1,214 @@
+#ifndef SCREEN_WORMS_METRICS_H
+#define SCREEN_WORMS_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Latency histograms count values up to each bound; the last bucket counts the rest.
+#define LATENCY_BUCKETS     17
+// Count histograms count values up to each bound; the last bucket counts the rest.
+#define COUNT_BUCKETS       13
+// Time a scraper gets to send its request before the answer is written anyway.
+#define METRICS_REQUEST_TIMEOUT_MS  100
+// Time the answer may wait for a scraper that does not read it.
+#define METRICS_SEND_TIMEOUT_MS     1000
+// Pause after accept fails, e.g. when descriptors run out.
+#define METRICS_ACCEPT_BACKOFF_MS   100
+
+inline constexpr uint64_t LATENCY_BOUNDS_NS[LATENCY_BUCKETS - 1] = {
+        1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+        1000000, 2500000, 5000000, 10000000, 25000000, 50000000, 100000000};
+
+inline constexpr uint64_t COUNT_BOUNDS[COUNT_BUCKETS - 1] = {
+        0, 1, 2, 4, 8, 16, 32, 64, 128, 256, 512, 1024};
+
+/*
+ * Metrics are written by a single thread, the one running their server, and read
+ * by the exporter. Writers update them with relaxed loads and stores, which compile
+ * to plain memory accesses, so no locked instruction is executed on the hot path.
+ */
+class MetricCounter {
+public:
+    MetricCounter() : value(0) {}
+
+    void add(uint64_t n = 1) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    /*
+     * Mirrors a monotonic total kept elsewhere.
+     */
+    void set(uint64_t total) {
+        value.store(total, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value;
+};
+
+class MetricGauge {
+public:
+    MetricGauge() : value(0) {}
+
+    void set(uint64_t current) {
+        value.store(current, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value;
+};
+
+class LatencyHistogram {
+public:
+    LatencyHistogram() : buckets{}, sum_ns(0) {}
+
+    void observe(uint64_t ns) {
+        size_t b = 0;
+        while (b < LATENCY_BUCKETS - 1 && ns > LATENCY_BOUNDS_NS[b])
+            ++b;
+        buckets[b].store(buckets[b].load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+        sum_ns.store(sum_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+    }
+
+    uint64_t get_bucket(size_t b) const {
+        return buckets[b].load(std::memory_order_relaxed);
+    }
+
+    uint64_t get_sum_ns() const {
+        return sum_ns.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+    std::atomic<uint64_t> sum_ns;
+};
+
+/*
+ * Distribution of small counts, e.g. of datagrams handled at once.
+ */
+class CountHistogram {
+public:
+    CountHistogram() : buckets{}, sum(0) {}
+
+    void observe(uint64_t n) {
+        size_t b = 0;
+        while (b < COUNT_BUCKETS - 1 && n > COUNT_BOUNDS[b])
+            ++b;
+        buckets[b].store(buckets[b].load(std::memory_order_relaxed) + 1,
+                         std::memory_order_relaxed);
+        sum.store(sum.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t get_bucket(size_t b) const {
+        return buckets[b].load(std::memory_order_relaxed);
+    }
+
+    uint64_t get_sum() const {
+        return sum.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> buckets[COUNT_BUCKETS];
+    std::atomic<uint64_t> sum;
+};
+
+/*
+ * Live metrics of a single server. Counters of the receive path and histograms are
+ * updated where things happen; the rest mirrors statistics of server's modules once
+ * per tick.
+ */
+struct server_metrics_t {
+    MetricCounter received_datagrams;
+    MetricCounter received_bytes;
+    MetricCounter received_wakeups;
+    MetricCounter invalid_datagrams;
+    MetricCounter dropped_inputs;
+    MetricCounter dropped_requests;
+    MetricCounter sent_datagrams;
+    MetricCounter sent_bytes;
+    MetricCounter send_failures;
+    MetricCounter gso_saved_sends;
+    MetricCounter gso_bytes;
+    MetricCounter catch_up_suppressed_bytes;
+    MetricCounter catch_up_paced_bytes;
+    MetricCounter snapshot_parts;
+    MetricCounter ticks;
+    MetricCounter missed_ticks;
+    MetricCounter dropped_ticks;
+    MetricCounter games;
+    MetricCounter snapshots;
+    MetricCounter events;
+    MetricCounter upstream_events;
+
+    MetricGauge waiting_messages;
+    MetricGauge payload_bytes;
+    MetricGauge deferred_commands;
+    MetricGauge players;
+    MetricGauge spectators;
+    MetricGauge worms;
+    MetricGauge game_events;
+    MetricGauge upstream_events_behind;
+    // Exported in seconds.
+    MetricGauge upstream_lag_ns;
+
+    LatencyHistogram check_timeout_ns;
+    LatencyHistogram new_round_ns;
+    LatencyHistogram snapshot_ns;
+    LatencyHistogram broadcast_ns;
+    LatencyHistogram tick_ns;
+    LatencyHistogram tick_lateness_ns;
+    LatencyHistogram tick_overrun_ns;
+    LatencyHistogram upstream_request_ns;
+    LatencyHistogram upstream_delay_ns;
+
+    CountHistogram drained_per_wakeup;
+};
+
+/*
+ * Serves metrics of registered servers in Prometheus text format on a Unix-domain
+ * socket. Every connection gets a single snapshot, prefixed with an HTTP/1.0 header
+ * so that both plain socket readers and HTTP scrapers understand it, and is closed.
+ * Scrapes are answered by a thread of their own and never pause ticks.
+ */
+class MetricsExporter {
+public:
+    MetricsExporter() : listen_fd(-1) {}
+
+    /*
+     * Registers metrics of server listening on [port]. Must be called before [start].
+     */
+    void add_server(int port, const server_metrics_t &metrics);
+
+    /*
+     * Binds socket at [path], replacing stale socket, and starts answering scrapes.
+     * Fails if [path] exists and is not a socket.
+     */
+    void start(const std::string &path);
+
+    /*
+     * Returns current values of all registered metrics in Prometheus text format.
+     */
+    std::string format() const;
+
+private:
+    [[noreturn]] void serve();
+
+    void answer(int fd) const;
+
+private:
+    int listen_fd;
+    std::vector<std::pair<int, const server_metrics_t *>> servers;
+};
+
+#endif //SCREEN_WORMS_METRICS_H
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cerrno>
+
+#include "outbound_queue.h"
+#include "err.h"
+
+void OutboundQueue::push(const PayloadRef &payload, const struct sockaddr_in6 &address,
+                         socklen_t address_len) {
+    if (count == ring.size())
+        grow();
+
+    descriptor_t &descriptor = ring[(head + count) % ring.size()];
+    descriptor.payload = payload;
+    descriptor.destination = intern_destination(address, address_len);
+    ++count;
+}
+
+bool OutboundQueue::send_front(int sock) {
+    descriptor_t &descriptor = ring[head];
+    destination_t &destination = destinations[descriptor.destination];
+
+    ssize_t len = sendto(sock, descriptor.payload.get_data(), descriptor.payload.get_length(),
+                         MSG_DONTWAIT, (struct sockaddr *)&destination.address,
+                         destination.address_len);
+    bool sent = len == ssize_t(descriptor.payload.get_length());
+    if (!sent && errno == ENOMEM)
+        syserr("sendto - no memory");
+
+    if (sent) {
+        ++send_stats.datagrams;
+        send_stats.bytes += len;
+        release_destination(descriptor.destination);
+        descriptor.payload.reset();
+        head = (head + 1) % ring.size();
+        --count;
+    }
+    else {
+        ++send_stats.failures;
+    }
+
+    // Moves unsent datagram to the end of the queue.
+    if (!sent && count > 1) {
+        descriptor_t moved = std::move(descriptor);
+        head = (head + 1) % ring.size();
+        ring[(head + count - 1) % ring.size()] = std::move(moved);
+    }
+
+    return sent;
+}
+
+void OutboundQueue::grow() {
+    std::vector<descriptor_t> bigger(std::max<size_t>(16, 2 * ring.size()));
+    for (size_t i = 0; i < count; ++i)
+        bigger[i] = std::move(ring[(head + i) % ring.size()]);
+
+    ring = std::move(bigger);
+    head = 0;
+}
+
+uint32_t OutboundQueue::intern_destination(const struct sockaddr_in6 &address,
+                                           socklen_t address_len) {
+    client_identity_t identity{address.sin6_addr, address.sin6_port};
+    auto it = destination_index.find(identity);
+    if (it != destination_index.end()) {
+        ++destinations[it->second].refs;
+        return it->second;
+    }
+
+    uint32_t index;
+    if (free_destinations.empty()) {
+        index = destinations.size();
+        destinations.emplace_back();
+    }
+    else {
+        index = free_destinations.back();
+        free_destinations.pop_back();
+    }
+
+    destinations[index] = {address, address_len, 1};
+    destination_index.insert({identity, index});
+    return index;
+}
+
+void OutboundQueue::release_destination(uint32_t index) {
+    destination_t &destination = destinations[index];
+    if (--destination.refs > 0)
+        return;
+
+    destination_index.erase({destination.address.sin6_addr, destination.address.sin6_port});
+    free_destinations.push_back(index);
+}
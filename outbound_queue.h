@@ -0,0 +1,80 @@
+#ifndef SCREEN_WORMS_OUTBOUND_QUEUE_H
+#define SCREEN_WORMS_OUTBOUND_QUEUE_H
+
+#include <unordered_map>
+#include <vector>
+#include <netinet/in.h>
+
+#include "payload_pool.h"
+#include "server_types.h"
+
+/*
+ * Datagrams and bytes handed to the kernel, and send calls that failed, mostly
+ * because the socket buffer was full.
+ */
+struct send_stats_t {
+    uint64_t datagrams;
+    uint64_t bytes;
+    uint64_t failures;
+};
+
+/*
+ * FIFO of datagrams waiting for the socket to become writable. Each entry is a small
+ * (payload reference, destination index) descriptor; payloads are shared with
+ * whoever else references them and destination addresses are interned, so queueing
+ * a broadcast datagram for many clients copies neither the payload nor the address.
+ */
+class OutboundQueue {
+public:
+    OutboundQueue() : head(0), count(0), send_stats{0, 0, 0} {}
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    size_t get_descriptor_count() const {
+        return count;
+    }
+
+    const send_stats_t &get_send_stats() const {
+        return send_stats;
+    }
+
+    void push(const PayloadRef &payload, const struct sockaddr_in6 &address,
+              socklen_t address_len);
+
+    /*
+     * Tries to send the first queued datagram. On failure the datagram is moved
+     * to the end of the queue, so one unreachable client does not block others.
+     * Returns [true] if datagram was sent.
+     */
+    bool send_front(int sock);
+
+private:
+    struct descriptor_t {
+        PayloadRef payload;
+        uint32_t destination;
+    };
+
+    struct destination_t {
+        struct sockaddr_in6 address;
+        socklen_t address_len;
+        uint32_t refs;
+    };
+
+    uint32_t intern_destination(const struct sockaddr_in6 &address, socklen_t address_len);
+    void release_destination(uint32_t index);
+    void grow();
+
+private:
+    // Ring of descriptors; grows by doubling and never shrinks.
+    std::vector<descriptor_t> ring;
+    size_t head;
+    size_t count;
+    std::vector<destination_t> destinations;
+    std::vector<uint32_t> free_destinations;
+    std::unordered_map<client_identity_t, uint32_t, IdentityHash, IdentityEqual> destination_index;
+    send_stats_t send_stats;
+};
+
+#endif //SCREEN_WORMS_OUTBOUND_QUEUE_H
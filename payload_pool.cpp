@@ -0,0 +1,33 @@
+#include "payload_pool.h"
+
+void PayloadRef::reset() {
+    if (block != nullptr && --block->refs == 0)
+        block->pool->release(block);
+    block = nullptr;
+}
+
+PayloadRef PayloadPool::make(const Buffer &buffer) {
+    if (free_blocks.empty()) {
+        chunks.emplace_back(new payload_block_t[PAYLOAD_POOL_CHUNK]);
+        for (size_t i = 0; i < PAYLOAD_POOL_CHUNK; ++i)
+            free_blocks.push_back(&chunks.back()[i]);
+    }
+
+    payload_block_t *block = free_blocks.back();
+    free_blocks.pop_back();
+
+    block->pool = this;
+    block->refs = 1;
+    block->length = buffer.get_length();
+    memcpy(block->data, buffer.get_data(), buffer.get_length());
+
+    ++payload_count;
+    payload_bytes += block->length;
+    return PayloadRef(block);
+}
+
+void PayloadPool::release(payload_block_t *block) {
+    --payload_count;
+    payload_bytes -= block->length;
+    free_blocks.push_back(block);
+}
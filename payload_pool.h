@@ -0,0 +1,102 @@
+#ifndef SCREEN_WORMS_PAYLOAD_POOL_H
+#define SCREEN_WORMS_PAYLOAD_POOL_H
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "buffer.h"
+
+#define PAYLOAD_POOL_CHUNK  64
+
+class PayloadPool;
+
+struct payload_block_t {
+    PayloadPool *pool;
+    uint32_t refs;
+    uint32_t length;
+    char data[DATAGRAM_SIZE];
+};
+
+/*
+ * Reference to an immutable, reference-counted datagram payload allocated from
+ * a [PayloadPool]. Copying a reference never copies the payload.
+ */
+class PayloadRef {
+public:
+    PayloadRef() : block(nullptr) {}
+
+    PayloadRef(const PayloadRef &other) : block(other.block) {
+        if (block != nullptr)
+            ++block->refs;
+    }
+
+    PayloadRef(PayloadRef &&other) noexcept : block(other.block) {
+        other.block = nullptr;
+    }
+
+    PayloadRef &operator=(PayloadRef other) noexcept {
+        std::swap(block, other.block);
+        return *this;
+    }
+
+    ~PayloadRef() {
+        reset();
+    }
+
+    const char *get_data() const {
+        return block->data;
+    }
+
+    size_t get_length() const {
+        return block->length;
+    }
+
+    void reset();
+
+private:
+    friend class PayloadPool;
+
+    explicit PayloadRef(payload_block_t *b) : block(b) {}
+
+    payload_block_t *block;
+};
+
+/*
+ * Pooled allocator of datagram payloads. Blocks are allocated in chunks and reused
+ * through a free list. The pool must outlive all references to its payloads and
+ * must be used by a single thread.
+ */
+class PayloadPool {
+public:
+    PayloadPool() : payload_count(0), payload_bytes(0) {}
+
+    PayloadPool(const PayloadPool &) = delete;
+    PayloadPool &operator=(const PayloadPool &) = delete;
+
+    /*
+     * Copies content of [buffer] into a new payload.
+     */
+    PayloadRef make(const Buffer &buffer);
+
+    size_t get_payload_count() const {
+        return payload_count;
+    }
+
+    size_t get_payload_bytes() const {
+        return payload_bytes;
+    }
+
+private:
+    friend class PayloadRef;
+
+    void release(payload_block_t *block);
+
+private:
+    std::vector<std::unique_ptr<payload_block_t[]>> chunks;
+    std::vector<payload_block_t *> free_blocks;
+    size_t payload_count;
+    size_t payload_bytes;
+};
+
+#endif //SCREEN_WORMS_PAYLOAD_POOL_H
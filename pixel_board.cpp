@@ -0,0 +1,19 @@
+#include "pixel_board.h"
+
+void PixelBoard::reset(coordinate_t board_width, coordinate_t board_height) {
+    if (board_width == width && board_height == height) {
+        clear();
+        return;
+    }
+
+    width = board_width;
+    height = board_height;
+    words.assign((size_t(width) * height + 63) / 64, 0);
+    dirty_words.clear();
+}
+
+void PixelBoard::clear() {
+    for (uint32_t index : dirty_words)
+        words[index] = 0;
+    dirty_words.clear();
+}
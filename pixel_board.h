@@ -0,0 +1,54 @@
+#ifndef SCREEN_WORMS_PIXEL_BOARD_H
+#define SCREEN_WORMS_PIXEL_BOARD_H
+
+#include <cstdint>
+#include <vector>
+
+#include "server_types.h"
+
+/*
+ * Dense bitmap of eaten pixels, one bit per pixel of the board. Words that got any
+ * bit set are remembered, so clearing the board touches only them.
+ */
+class PixelBoard {
+public:
+    PixelBoard() : width(0), height(0) {}
+
+    /*
+     * Clears the board and sets its size.
+     */
+    void reset(coordinate_t board_width, coordinate_t board_height);
+
+    /*
+     * Marks [pixel] as eaten. Returns [false] if it is off the board or already eaten.
+     */
+    bool eat(const pixel_t &pixel) {
+        // Negative coordinates wrapped around, so a single comparison per axis suffices.
+        if (pixel.first >= width || pixel.second >= height)
+            return false;
+
+        size_t index = size_t(pixel.second) * width + pixel.first;
+        uint64_t &word = words[index / 64];
+        uint64_t bit = uint64_t(1) << (index % 64);
+        if (word & bit)
+            return false;
+
+        if (word == 0)
+            dirty_words.push_back(index / 64);
+        word |= bit;
+        return true;
+    }
+
+    /*
+     * Clears all eaten pixels.
+     */
+    void clear();
+
+private:
+    coordinate_t width;
+    coordinate_t height;
+    std::vector<uint64_t> words;
+    std::vector<uint32_t> dirty_words;
+};
+
+#endif //SCREEN_WORMS_PIXEL_BOARD_H
@@ -0,0 +1,85 @@
+#include <cstring>
+
+#include "published_log.h"
+#include "err.h"
+
+PublishedLog::PublishedLog(game_id_t game_id, bool wide) : game_id(game_id), wide(wide), size(0),
+        published(0) {
+    offsets[0] = std::make_unique<uint64_t[]>(size_t(1) << PUBLISHED_OFFSETS_SHIFT);
+    offsets[0][0] = 0;
+}
+
+void PublishedLog::append(const EventCollection &events, size_t first, size_t last) {
+    uint64_t end = get_offset(size);
+    const char *data = events.get_event_data(first);
+    size_t length = events.get_bytes_between(first, last);
+    if (((end + length) >> PUBLISHED_BYTES_SHIFT) >= PUBLISHED_MAX_CHUNKS ||
+        ((size + last - first + 1) >> PUBLISHED_OFFSETS_SHIFT) >= PUBLISHED_MAX_CHUNKS)
+        fatal("game %u is too long to be published", game_id);
+
+    // Copies bytes chunk by chunk.
+    for (size_t copied = 0; copied < length; ) {
+        uint64_t position = end + copied;
+        auto &chunk = bytes[position >> PUBLISHED_BYTES_SHIFT];
+        if (chunk == nullptr)
+            chunk = std::make_unique<char[]>(size_t(1) << PUBLISHED_BYTES_SHIFT);
+
+        size_t part = std::min<size_t>(length - copied, BYTES_MASK + 1 - (position & BYTES_MASK));
+        memcpy(chunk.get() + (position & BYTES_MASK), data + copied, part);
+        copied += part;
+    }
+
+    for (size_t event = first; event < last; ++event) {
+        ++size;
+        auto &chunk = offsets[size >> PUBLISHED_OFFSETS_SHIFT];
+        if (chunk == nullptr)
+            chunk = std::make_unique<uint64_t[]>(size_t(1) << PUBLISHED_OFFSETS_SHIFT);
+        chunk[size & OFFSETS_MASK] = end + events.get_bytes_between(first, event + 1);
+    }
+}
+
+event_no_t PublishedLog::fill_datagram(event_no_t first, size_t last, Buffer &datagram) const {
+    datagram.clear();
+    datagram.insert_number(game_id);
+
+    // Datagrams hold a few dozen events at most, so they are counted one by one.
+    uint64_t start = get_offset(first);
+    uint64_t limit = start + datagram.get_space_left();
+    event_no_t next = first;
+    while (next < last && get_offset(next + 1) <= limit)
+        ++next;
+
+    uint64_t end = get_offset(next);
+    for (uint64_t position = start; position < end; ) {
+        size_t part = std::min<uint64_t>(end - position, BYTES_MASK + 1 - (position & BYTES_MASK));
+        datagram.insert_bytes(bytes[position >> PUBLISHED_BYTES_SHIFT].get() +
+                              (position & BYTES_MASK), part);
+        position += part;
+    }
+
+    return next;
+}
+
+const char *PublishedLog::get_event(size_t event, char *scratch) const {
+    uint64_t start = get_offset(event);
+    uint64_t end = get_offset(event + 1);
+    if ((start >> PUBLISHED_BYTES_SHIFT) == ((end - 1) >> PUBLISHED_BYTES_SHIFT))
+        return bytes[start >> PUBLISHED_BYTES_SHIFT].get() + (start & BYTES_MASK);
+
+    size_t part = BYTES_MASK + 1 - (start & BYTES_MASK);
+    memcpy(scratch, bytes[start >> PUBLISHED_BYTES_SHIFT].get() + (start & BYTES_MASK), part);
+    memcpy(scratch + part, bytes[end >> PUBLISHED_BYTES_SHIFT].get(), end - start - part);
+    return scratch;
+}
+
+event_no_t PublishedLog::fill_compact_datagram(event_no_t first, size_t last,
+                                               CompactEncoder &encoder) const {
+    char scratch[MAX_EVENT_LENGTH];
+    encoder.begin(game_id, first);
+    event_no_t next = first;
+    while (next < last && encoder.add(get_event(next, scratch)))
+        ++next;
+    encoder.finish();
+
+    return next;
+}
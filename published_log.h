@@ -0,0 +1,104 @@
+#ifndef SCREEN_WORMS_PUBLISHED_LOG_H
+#define SCREEN_WORMS_PUBLISHED_LOG_H
+
+#include <atomic>
+#include <memory>
+
+#include "buffer.h"
+#include "event_collection.h"
+#include "compact_events.h"
+
+// Serialized events are kept in chunks of 2^20 bytes and their offsets in chunks
+// of 2^16 entries; chunks never move once allocated.
+#define PUBLISHED_BYTES_SHIFT   20
+#define PUBLISHED_OFFSETS_SHIFT 16
+#define PUBLISHED_MAX_CHUNKS    1024
+
+/*
+ * Copy of the event log of a single game that sender threads read while the
+ * simulation thread keeps appending to it. Events up to [get_published()] are
+ * immutable; the writer only touches memory past them, so readers need no locks.
+ */
+class PublishedLog {
+public:
+    PublishedLog(game_id_t game_id, bool wide);
+
+    PublishedLog(const PublishedLog &) = delete;
+    PublishedLog &operator=(const PublishedLog &) = delete;
+
+    game_id_t get_game_id() const {
+        return game_id;
+    }
+
+    /*
+     * Checks if the game has wide events, which only clients that negotiated them get.
+     */
+    bool is_wide() const {
+        return wide;
+    }
+
+    /*
+     * Called by the writer. Appends events from [first] to [last] (exclusive) of
+     * [events]; readers see them after [publish].
+     */
+    void append(const EventCollection &events, size_t first, size_t last);
+
+    /*
+     * Called by the writer. Makes all appended events visible to readers.
+     */
+    void publish() {
+        published.store(size, std::memory_order_release);
+    }
+
+    /*
+     * Number of events readers may access.
+     */
+    size_t get_published() const {
+        return published.load(std::memory_order_acquire);
+    }
+
+    /*
+     * Returns total length of published events from [first] to [last] (exclusive).
+     */
+    size_t get_bytes_between(size_t first, size_t last) const {
+        return get_offset(last) - get_offset(first);
+    }
+
+    /*
+     * Fills [datagram] with as many events of [first] to [last] (exclusive) as fit,
+     * preceded by the game id. Returns number of the first event that did not fit.
+     */
+    event_no_t fill_datagram(event_no_t first, size_t last, Buffer &datagram) const;
+
+    /*
+     * Encodes as many events of [first] to [last] (exclusive) as fit into a compact
+     * datagram of [encoder]. Returns number of the first event that did not fit.
+     */
+    event_no_t fill_compact_datagram(event_no_t first, size_t last,
+                                     CompactEncoder &encoder) const;
+
+private:
+    /*
+     * Returns published event [event], copied to [scratch] if it spans two chunks.
+     */
+    const char *get_event(size_t event, char *scratch) const;
+
+    uint64_t get_offset(size_t event) const {
+        return offsets[event >> PUBLISHED_OFFSETS_SHIFT][event & OFFSETS_MASK];
+    }
+
+    static constexpr size_t OFFSETS_MASK = (size_t(1) << PUBLISHED_OFFSETS_SHIFT) - 1;
+    static constexpr size_t BYTES_MASK = (size_t(1) << PUBLISHED_BYTES_SHIFT) - 1;
+
+private:
+    game_id_t game_id;
+    bool wide;
+    std::unique_ptr<char[]> bytes[PUBLISHED_MAX_CHUNKS];
+    // Offset of every event in [bytes]; has one extra entry.
+    std::unique_ptr<uint64_t[]> offsets[PUBLISHED_MAX_CHUNKS];
+    // Events appended so far; accessed by the writer only.
+    size_t size;
+    std::atomic<size_t> published;
+};
+
+#endif //SCREEN_WORMS_PUBLISHED_LOG_H
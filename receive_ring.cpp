@@ -0,0 +1,32 @@
+#include <cerrno>
+
+#include "receive_ring.h"
+#include "err.h"
+
+ReceiveRing::ReceiveRing(size_t batch_size) : buffers(batch_size), addresses(batch_size),
+        iovecs(batch_size), msgs(batch_size) {
+    for (size_t i = 0; i < batch_size; ++i) {
+        iovecs[i].iov_base = buffers[i].get_data();
+        iovecs[i].iov_len = DATAGRAM_SIZE;
+
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_hdr.msg_iov = &iovecs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_name = &addresses[i];
+    }
+}
+
+size_t ReceiveRing::receive(int sock) {
+    // Address lengths are overwritten by every call.
+    for (auto &msg : msgs)
+        msg.msg_hdr.msg_namelen = sizeof(struct sockaddr_in6);
+
+    int received = recvmmsg(sock, msgs.data(), msgs.size(), MSG_DONTWAIT, nullptr);
+    if (received < 0) {
+        if (errno == ENOMEM)
+            syserr("recvmmsg - no memory");
+        return 0;
+    }
+
+    return received;
+}
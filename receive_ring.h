@@ -0,0 +1,57 @@
+#ifndef SCREEN_WORMS_RECEIVE_RING_H
+#define SCREEN_WORMS_RECEIVE_RING_H
+
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "buffer.h"
+
+#define DEFAULT_RECV_BATCH_SIZE 32
+#define MAX_RECV_BATCH_SIZE     1024
+
+/*
+ * Preallocated set of receive buffers and address slots drained with a single
+ * recvmmsg call.
+ */
+class ReceiveRing {
+public:
+    explicit ReceiveRing(size_t batch_size);
+
+    ReceiveRing(const ReceiveRing &) = delete;
+    ReceiveRing &operator=(const ReceiveRing &) = delete;
+
+    size_t get_batch_size() const {
+        return buffers.size();
+    }
+
+    /*
+     * Receives up to [get_batch_size()] datagrams from [sock] without blocking.
+     * Returns number of received datagrams.
+     */
+    size_t receive(int sock);
+
+    Buffer &get_buffer(size_t index) {
+        return buffers[index];
+    }
+
+    ssize_t get_length(size_t index) const {
+        return msgs[index].msg_len;
+    }
+
+    const struct sockaddr_in6 &get_address(size_t index) const {
+        return addresses[index];
+    }
+
+    socklen_t get_address_len(size_t index) const {
+        return msgs[index].msg_hdr.msg_namelen;
+    }
+
+private:
+    std::vector<Buffer> buffers;
+    std::vector<struct sockaddr_in6> addresses;
+    std::vector<struct iovec> iovecs;
+    std::vector<struct mmsghdr> msgs;
+};
+
+#endif //SCREEN_WORMS_RECEIVE_RING_H
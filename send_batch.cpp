@@ -0,0 +1,132 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <netinet/udp.h>
+
+#include "send_batch.h"
+#include "err.h"
+
+size_t SendBatch::add_payload(const Buffer &payload) {
+    payloads.push_back(pool.make(payload));
+    return payloads.size() - 1;
+}
+
+void SendBatch::add_destination(size_t payload, const struct sockaddr_in6 &address,
+                                socklen_t address_len) {
+    destinations.push_back({payload, address, address_len});
+}
+
+bool SendBatch::same_destination(size_t i, size_t j) const {
+    const destination_t &a = destinations[i];
+    const destination_t &b = destinations[j];
+    return a.address_len == b.address_len && a.address.sin6_port == b.address.sin6_port &&
+        memcmp(&a.address.sin6_addr, &b.address.sin6_addr, sizeof(a.address.sin6_addr)) == 0;
+}
+
+void SendBatch::build_messages() {
+    // Headers are built only now, as destinations may have been moved while adding.
+    size_t count = destinations.size();
+    iovecs.resize(count);
+    for (size_t i = sent; i < count; ++i) {
+        const PayloadRef &payload = payloads[destinations[i].payload];
+        iovecs[i].iov_base = const_cast<char *>(payload.get_data());
+        iovecs[i].iov_len = payload.get_length();
+    }
+
+    msgs.clear();
+    controls.clear();
+    message_starts.assign(1, sent);
+    for (size_t i = sent; i < count; ) {
+        // All segments but the last one must have the length of the first one.
+        size_t segment = iovecs[i].iov_len;
+        size_t j = i + 1;
+        while (gso_enabled && j < count && j - i < GSO_MAX_SEGMENTS && same_destination(i, j) &&
+                iovecs[j - 1].iov_len == segment && iovecs[j].iov_len <= segment)
+            ++j;
+
+        struct mmsghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_hdr.msg_name = &destinations[i].address;
+        msg.msg_hdr.msg_namelen = destinations[i].address_len;
+        msg.msg_hdr.msg_iov = &iovecs[i];
+        msg.msg_hdr.msg_iovlen = j - i;
+        msgs.push_back(msg);
+        controls.emplace_back();
+        message_starts.push_back(j);
+        i = j;
+    }
+
+    // Attaches segment size to GSO messages; [controls] does not move any more.
+    for (size_t m = 0; m < msgs.size(); ++m) {
+        struct msghdr &hdr = msgs[m].msg_hdr;
+        if (hdr.msg_iovlen < 2)
+            continue;
+
+        hdr.msg_control = controls[m].buf;
+        hdr.msg_controllen = sizeof(controls[m].buf);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t segment = hdr.msg_iov[0].iov_len;
+        memcpy(CMSG_DATA(cmsg), &segment, sizeof(segment));
+    }
+}
+
+bool SendBatch::flush(int sock) {
+    build_messages();
+
+    size_t next_msg = 0;
+    while (next_msg < msgs.size()) {
+        unsigned int chunk = std::min<size_t>(msgs.size() - next_msg, SENDMMSG_MAX_CHUNK);
+        int ret = sendmmsg(sock, msgs.data() + next_msg, chunk, MSG_DONTWAIT);
+        if (ret <= 0) {
+            if (ret < 0 && errno == ENOMEM)
+                syserr("sendmmsg - no memory");
+
+            // Kernel or device does not support GSO, so it is turned off and unsent
+            // datagrams are split into separate messages.
+            bool gso_message = msgs[next_msg].msg_hdr.msg_iovlen > 1;
+            if (ret < 0 && gso_message && (errno == EIO || errno == EINVAL ||
+                    errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+                fprintf(stderr, "UDP GSO is not supported, sending datagrams separately\n");
+                gso_enabled = false;
+                build_messages();
+                next_msg = 0;
+                continue;
+            }
+            ++send_stats.failures;
+            return false;
+        }
+
+        for (int m = 0; m < ret; ++m) {
+            const struct msghdr &hdr = msgs[next_msg + m].msg_hdr;
+            send_stats.datagrams += hdr.msg_iovlen;
+            send_stats.bytes += msgs[next_msg + m].msg_len;
+            if (hdr.msg_iovlen > 1) {
+                gso_stats.saved_calls += hdr.msg_iovlen - 1;
+                gso_stats.bytes += msgs[next_msg + m].msg_len;
+            }
+        }
+        next_msg += ret;
+        sent = message_starts[next_msg];
+    }
+
+    return true;
+}
+
+void SendBatch::move_unsent(OutboundQueue &queue) {
+    for (size_t i = sent; i < destinations.size(); ++i) {
+        const destination_t &destination = destinations[i];
+        queue.push(payloads[destination.payload], destination.address, destination.address_len);
+    }
+
+    clear();
+}
+
+void SendBatch::clear() {
+    payloads.clear();
+    destinations.clear();
+    sent = 0;
+}
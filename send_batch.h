@@ -0,0 +1,125 @@
+#ifndef SCREEN_WORMS_SEND_BATCH_H
+#define SCREEN_WORMS_SEND_BATCH_H
+
+#include <vector>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "buffer.h"
+#include "payload_pool.h"
+#include "outbound_queue.h"
+
+// Kernel limit of messages processed by a single sendmmsg call.
+#define SENDMMSG_MAX_CHUNK  1024
+// Kernel limit of segments in a single UDP GSO send.
+#define GSO_MAX_SEGMENTS    64
+
+/*
+ * Datagrams that did not need a message of their own thanks to UDP GSO, and bytes
+ * sent in GSO messages.
+ */
+struct gso_stats_t {
+    uint64_t saved_calls;
+    uint64_t bytes;
+};
+
+/*
+ * Collects outbound datagrams and sends them with sendmmsg. A payload is stored
+ * once and may be addressed to any number of destinations.
+ *
+ * Consecutive datagrams to the same destination that have equal length (optionally
+ * followed by one shorter datagram) are sent as a single UDP GSO message with
+ * UDP_SEGMENT, which the kernel splits into exactly the same datagrams. If the kernel
+ * rejects GSO, the batch falls back to one message per datagram for good.
+ */
+class SendBatch {
+public:
+    struct destination_t {
+        size_t payload;
+        struct sockaddr_in6 address;
+        socklen_t address_len;
+    };
+
+    explicit SendBatch(PayloadPool &pool) : pool(pool), sent(0), gso_enabled(true),
+            gso_stats{0, 0}, send_stats{0, 0, 0} {}
+
+    bool empty() const {
+        return sent == destinations.size();
+    }
+
+    size_t get_payload_count() const {
+        return payloads.size();
+    }
+
+    const PayloadRef &get_payload(size_t index) const {
+        return payloads[index];
+    }
+
+    const std::vector<destination_t> &get_destinations() const {
+        return destinations;
+    }
+
+    const gso_stats_t &get_gso_stats() const {
+        return gso_stats;
+    }
+
+    const send_stats_t &get_send_stats() const {
+        return send_stats;
+    }
+
+    /*
+     * Copies [payload] into the pool and returns its index.
+     */
+    size_t add_payload(const Buffer &payload);
+
+    /*
+     * Schedules payload with given index to be sent to [address].
+     */
+    void add_destination(size_t payload, const struct sockaddr_in6 &address,
+                         socklen_t address_len);
+
+    /*
+     * Sends scheduled datagrams, resuming after the last one sent by previous call.
+     * Returns [true] if all scheduled datagrams were sent.
+     */
+    bool flush(int sock);
+
+    /*
+     * Pushes datagrams that were not sent yet into [queue] and empties the batch.
+     */
+    void move_unsent(OutboundQueue &queue);
+
+    /*
+     * Drops all scheduled datagrams.
+     */
+    void clear();
+
+private:
+    union gso_control_t {
+        char buf[CMSG_SPACE(sizeof(uint16_t))];
+        struct cmsghdr align;
+    };
+
+    /*
+     * Builds message headers for datagrams that were not sent yet.
+     */
+    void build_messages();
+
+    bool same_destination(size_t i, size_t j) const;
+
+private:
+    PayloadPool &pool;
+    std::vector<PayloadRef> payloads;
+    std::vector<destination_t> destinations;
+    std::vector<struct iovec> iovecs;
+    std::vector<struct mmsghdr> msgs;
+    // Index of the first datagram of every message and one past the last one.
+    std::vector<size_t> message_starts;
+    std::vector<gso_control_t> controls;
+    size_t sent;
+    bool gso_enabled;
+    gso_stats_t gso_stats;
+    send_stats_t send_stats;
+};
+
+#endif //SCREEN_WORMS_SEND_BATCH_H
@@ -0,0 +1,410 @@
+#include <cerrno>
+#include <ctime>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <thread>
+#include <unistd.h>
+
+#include "sender_pool.h"
+#include "err.h"
+
+namespace {
+    uint64_t monotonic_ns() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+}
+
+SenderThread::SenderThread(int sock, size_t index, size_t count) : sock(sock), index(index),
+        count(count), commands(SENDER_COMMANDS_SIZE), broadcast_up_to(0),
+        send_batch(payload_pool), suppressed_bytes(0), paced_bytes(0),
+        snapshot_parts(0) {
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd < 0)
+        syserr("eventfd");
+}
+
+SenderThread::~SenderThread() {
+    close(wake_fd);
+}
+
+void SenderThread::start() {
+    std::thread thread(&SenderThread::run, this);
+    std::string name = "sw-send" + std::to_string(index);
+    pthread_setname_np(thread.native_handle(), name.c_str());
+    thread.detach();
+}
+
+void SenderThread::wake() {
+    uint64_t one = 1;
+    ssize_t ignored = write(wake_fd, &one, sizeof(one));
+    (void)ignored;
+}
+
+SenderThread::client_t &SenderThread::get_client(slot_t slot) {
+    size_t i = slot / count;
+    if (i >= clients.size())
+        clients.resize(i + 1, client_t{});
+    return clients[i];
+}
+
+void SenderThread::handle(sender_command_t &command, uint64_t now) {
+    switch (command.type) {
+        case SENDER_CONNECT: {
+            client_t &client = get_client(command.slot);
+            client = client_t{};
+            client.connected = true;
+            client.address = command.address;
+            client.address_len = command.address_len;
+            client.compact_events = command.compact_events;
+            client.snapshots = command.snapshots;
+            client.wide_events = command.wide_events;
+            client.tokens = CATCHUP_BURST_BYTES;
+            client.tokens_updated_ns = now;
+            break;
+        }
+        case SENDER_DISCONNECT:
+            get_client(command.slot).connected = false;
+            break;
+        case SENDER_REQUEST: {
+            client_t &client = get_client(command.slot);
+            if (client.connected && log != nullptr && gets_events(client))
+                send_answer(client, command.first, now);
+            break;
+        }
+        case SENDER_NEW_GAME:
+            log = std::move(command.log);
+            broadcast_up_to = 0;
+            snapshot.reset();
+            break;
+        case SENDER_SNAPSHOT:
+            snapshot = std::move(command.snapshot);
+            break;
+    }
+}
+
+void SenderThread::send_answer(client_t &client, event_no_t first, uint64_t now) {
+    size_t published = log->get_published();
+    // Cursor refers to events of a previous game.
+    if (client.cursor_game != log->get_game_id() || client.sent_up_to > published) {
+        client.cursor_game = log->get_game_id();
+        client.sent_up_to = 0;
+        client.last_sent_ns = 0;
+    }
+
+    if (first >= published)
+        return;
+
+    // Requested range is still in flight, so only events after it are sent.
+    if (first < client.sent_up_to && now - client.last_sent_ns < CATCHUP_RESEND_INTERVAL_NS) {
+        suppressed_bytes += log->get_bytes_between(first, client.sent_up_to);
+        first = client.sent_up_to;
+    }
+
+    send_catch_up(client, first, now);
+}
+
+size_t SenderThread::send_catch_up(client_t &client, event_no_t first, uint64_t now) {
+    // Only events broadcast already are sent, so that no event is sent twice in a row.
+    size_t last = broadcast_up_to;
+
+    // Refills token bucket.
+    client.tokens = std::min<double>(CATCHUP_BURST_BYTES, client.tokens +
+            double(now - client.tokens_updated_ns) * CATCHUP_BYTES_PER_SEC / 1e9);
+    client.tokens_updated_ns = now;
+
+    // Snapshot being sent no longer stands for any requested event.
+    if (client.snapshot != nullptr &&
+        (client.snapshot->get_game_id() != log->get_game_id() ||
+         first >= client.snapshot->get_watermark())) {
+        client.snapshot.reset();
+    }
+
+    if (client.snapshot == nullptr && client.snapshots && snapshot != nullptr &&
+        snapshot->get_game_id() == log->get_game_id() && first < snapshot->get_watermark() &&
+        snapshot->get_watermark() <= last &&
+        snapshot->get_bytes() < log->get_bytes_between(
+            std::max(first, snapshot->get_header_events()), snapshot->get_watermark())) {
+        client.snapshot = snapshot;
+        client.snapshot_part = 0;
+    }
+
+    size_t scheduled = 0;
+    event_no_t next_event = first;
+    client.catch_up_pending = false;
+    // Events announcing the game are followed by the snapshot standing for events up to
+    // its watermark.
+    bool done = true;
+    if (client.snapshot != nullptr) {
+        done = schedule_events(client, next_event, client.snapshot->get_header_events(),
+                               scheduled) && schedule_snapshot(client, scheduled);
+        if (done) {
+            next_event = std::max(next_event, client.snapshot->get_watermark());
+            client.snapshot.reset();
+        }
+    }
+    if (done)
+        schedule_events(client, next_event, last, scheduled);
+
+    if (scheduled > 0)
+        client.last_sent_ns = now;
+    client.sent_up_to = next_event;
+
+    return scheduled;
+}
+
+bool SenderThread::schedule_events(client_t &client, event_no_t &next_event, size_t last,
+                                   size_t &scheduled) {
+    last = std::min(last, broadcast_up_to);
+    while (last > next_event) {
+        event_no_t after;
+        const Buffer &buf = fill_datagram(client.compact_events, next_event, last, after);
+        if (client.tokens < buf.get_length()) {
+            client.catch_up_pending = true;
+            return false;
+        }
+
+        client.tokens -= buf.get_length();
+        scheduled += buf.get_length();
+        send_batch.add_destination(send_batch.add_payload(buf), client.address,
+                                   client.address_len);
+        next_event = after;
+    }
+
+    return true;
+}
+
+bool SenderThread::schedule_snapshot(client_t &client, size_t &scheduled) {
+    for (; client.snapshot_part < client.snapshot->get_part_count(); ++client.snapshot_part) {
+        const Buffer &buf = client.snapshot->get_part(client.snapshot_part);
+        if (client.tokens < buf.get_length()) {
+            client.catch_up_pending = true;
+            return false;
+        }
+
+        client.tokens -= buf.get_length();
+        scheduled += buf.get_length();
+        ++snapshot_parts;
+        send_batch.add_destination(send_batch.add_payload(buf), client.address,
+                                   client.address_len);
+    }
+
+    return true;
+}
+
+const Buffer &SenderThread::fill_datagram(bool compact, event_no_t first, size_t last,
+                                          event_no_t &next) {
+    if (compact) {
+        next = log->fill_compact_datagram(first, last, compact_encoder);
+        return compact_encoder.get_datagram();
+    }
+
+    next = log->fill_datagram(first, last, datagram);
+    return datagram;
+}
+
+void SenderThread::broadcast(uint64_t now) {
+    size_t published = log->get_published();
+
+    // Every encoding is packed only if some client asked for it.
+    bool encodings[2] = {false, false};
+    if (published > broadcast_up_to) {
+        for (const client_t &client : clients) {
+            if (client.connected && gets_events(client))
+                encodings[client.compact_events] = true;
+        }
+    }
+
+    for (bool compact : {false, true}) {
+        event_no_t next_event = broadcast_up_to;
+        while (encodings[compact] && published > next_event) {
+            const Buffer &buf = fill_datagram(compact, next_event, published, next_event);
+
+            // Datagram is stored once and addressed to all clients of its encoding.
+            size_t payload = send_batch.add_payload(buf);
+            for (const client_t &client : clients) {
+                if (client.connected && client.compact_events == compact && gets_events(client))
+                    send_batch.add_destination(payload, client.address, client.address_len);
+            }
+        }
+    }
+
+    // Clients that were up to date got all new events with this broadcast; the rest
+    // continues catch-ups cut by byte budget.
+    for (client_t &client : clients) {
+        if (!client.connected)
+            continue;
+        if (client.cursor_game == log->get_game_id() && client.sent_up_to >= broadcast_up_to)
+            client.sent_up_to = published;
+        else if (client.catch_up_pending && client.cursor_game == log->get_game_id())
+            paced_bytes += send_catch_up(client, client.sent_up_to, now);
+        else
+            client.catch_up_pending = false;
+    }
+
+    broadcast_up_to = published;
+}
+
+void SenderThread::flush() {
+    // Datagrams cannot overtake the ones already waiting.
+    if (waiting_messages.empty())
+        send_batch.flush(sock);
+
+    send_batch.move_unsent(waiting_messages);
+}
+
+void SenderThread::publish_metrics() {
+    const send_stats_t &batch = send_batch.get_send_stats();
+    const send_stats_t &queue = waiting_messages.get_send_stats();
+    metrics.sent_datagrams.set(batch.datagrams + queue.datagrams);
+    metrics.sent_bytes.set(batch.bytes + queue.bytes);
+    metrics.send_failures.set(batch.failures + queue.failures);
+    metrics.gso_saved_sends.set(send_batch.get_gso_stats().saved_calls);
+    metrics.gso_bytes.set(send_batch.get_gso_stats().bytes);
+    metrics.catch_up_suppressed_bytes.set(suppressed_bytes);
+    metrics.catch_up_paced_bytes.set(paced_bytes);
+    metrics.snapshot_parts.set(snapshot_parts);
+    metrics.waiting_messages.set(waiting_messages.get_descriptor_count());
+    metrics.payload_bytes.set(payload_pool.get_payload_bytes());
+}
+
+[[noreturn]] void SenderThread::run() {
+    struct pollfd poll_fds[2] = {{wake_fd, POLLIN, 0}, {sock, 0, 0}};
+
+    while (true) {
+        poll_fds[0].revents = 0;
+        poll_fds[1].revents = 0;
+        // Socket is examined only while datagrams wait for it to become writable.
+        poll_fds[1].events = waiting_messages.empty() ? 0 : POLLOUT;
+        if (poll(poll_fds, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            syserr("poll");
+        }
+
+        if (poll_fds[1].revents & POLLOUT) {
+            while (!waiting_messages.empty() && waiting_messages.send_front(sock)) {}
+        }
+
+        if (poll_fds[0].revents & POLLIN) {
+            uint64_t wakeups;
+            ssize_t ignored = read(wake_fd, &wakeups, sizeof(wakeups));
+            (void)ignored;
+
+            uint64_t now = monotonic_ns();
+            sender_command_t command;
+            while (commands.try_pop(command))
+                handle(command, now);
+
+            if (log != nullptr)
+                broadcast(now);
+            flush();
+        }
+
+        publish_metrics();
+    }
+}
+
+void SenderPool::start(int sock, size_t count) {
+    for (size_t i = 0; i < count; ++i)
+        senders.push_back(std::make_unique<SenderThread>(sock, i, count));
+    deferred.resize(count);
+    for (auto &sender : senders)
+        sender->start();
+}
+
+void SenderPool::push(size_t sender, sender_command_t &command) {
+    push_deferred(sender);
+    if (!deferred[sender].empty() || !senders[sender]->push(command))
+        deferred[sender].push_back(std::move(command));
+}
+
+void SenderPool::push_deferred(size_t sender) {
+    std::deque<sender_command_t> &commands = deferred[sender];
+    while (!commands.empty() && senders[sender]->push(commands.front()))
+        commands.pop_front();
+}
+
+void SenderPool::connect(slot_t slot, const struct sockaddr_in6 &address,
+                         socklen_t address_len, bool compact_events, bool snapshots,
+                         bool wide_events) {
+    sender_command_t command{SENDER_CONNECT, slot, 0, address, address_len, compact_events,
+                             snapshots, wide_events, nullptr, nullptr};
+    push(slot % senders.size(), command);
+}
+
+void SenderPool::disconnect(slot_t slot) {
+    sender_command_t command{SENDER_DISCONNECT, slot, 0, {}, 0, false, false, false, nullptr,
+                             nullptr};
+    push(slot % senders.size(), command);
+}
+
+void SenderPool::request(slot_t slot, event_no_t first) {
+    sender_command_t command{SENDER_REQUEST, slot, first, {}, 0, false, false, false, nullptr,
+                             nullptr};
+    // Request cannot overtake deferred commands, e.g. connection of its client.
+    size_t sender = slot % senders.size();
+    push_deferred(sender);
+    if (!deferred[sender].empty() || !senders[sender]->push(command))
+        ++dropped_requests;
+}
+
+void SenderPool::new_game(const std::shared_ptr<const PublishedLog> &log) {
+    for (size_t i = 0; i < senders.size(); ++i) {
+        sender_command_t command{SENDER_NEW_GAME, 0, 0, {}, 0, false, false, false, log, nullptr};
+        push(i, command);
+    }
+}
+
+void SenderPool::new_snapshot(const std::shared_ptr<const BoardSnapshot> &snapshot) {
+    for (size_t i = 0; i < senders.size(); ++i) {
+        sender_command_t command{SENDER_SNAPSHOT, 0, 0, {}, 0, false, false, false, nullptr,
+                                 snapshot};
+        push(i, command);
+    }
+}
+
+void SenderPool::wake() {
+    for (size_t i = 0; i < senders.size(); ++i) {
+        push_deferred(i);
+        senders[i]->wake();
+    }
+}
+
+void SenderPool::collect_metrics(server_metrics_t &server) const {
+    uint64_t sent_datagrams = 0, sent_bytes = 0, send_failures = 0, gso_saved_sends = 0;
+    uint64_t gso_bytes = 0;
+    uint64_t suppressed_bytes = 0, paced_bytes = 0, snapshot_parts = 0, waiting = 0;
+    uint64_t payload_bytes = 0;
+    for (const auto &sender : senders) {
+        const sender_metrics_t &m = sender->get_metrics();
+        sent_datagrams += m.sent_datagrams.get();
+        sent_bytes += m.sent_bytes.get();
+        send_failures += m.send_failures.get();
+        gso_saved_sends += m.gso_saved_sends.get();
+        gso_bytes += m.gso_bytes.get();
+        suppressed_bytes += m.catch_up_suppressed_bytes.get();
+        paced_bytes += m.catch_up_paced_bytes.get();
+        snapshot_parts += m.snapshot_parts.get();
+        waiting += m.waiting_messages.get();
+        payload_bytes += m.payload_bytes.get();
+    }
+
+    server.sent_datagrams.set(sent_datagrams);
+    server.sent_bytes.set(sent_bytes);
+    server.send_failures.set(send_failures);
+    server.gso_saved_sends.set(gso_saved_sends);
+    server.gso_bytes.set(gso_bytes);
+    server.catch_up_suppressed_bytes.set(suppressed_bytes);
+    server.catch_up_paced_bytes.set(paced_bytes);
+    server.snapshot_parts.set(snapshot_parts);
+    server.waiting_messages.set(waiting);
+    server.payload_bytes.set(payload_bytes);
+    server.dropped_requests.set(dropped_requests);
+    size_t deferred_commands = 0;
+    for (const auto &commands : deferred)
+        deferred_commands += commands.size();
+    server.deferred_commands.set(deferred_commands);
+}
@@ -0,0 +1,248 @@
+#ifndef SCREEN_WORMS_SENDER_POOL_H
+#define SCREEN_WORMS_SENDER_POOL_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <netinet/in.h>
+
+#include "server_types.h"
+#include "buffer.h"
+#include "payload_pool.h"
+#include "outbound_queue.h"
+#include "send_batch.h"
+#include "published_log.h"
+#include "board_snapshot.h"
+#include "metrics.h"
+#include "spsc_ring.h"
+
+#define MAX_SENDER_THREADS      64
+#define SENDER_COMMANDS_SIZE    16384
+
+enum sender_command_type {
+    SENDER_CONNECT,
+    SENDER_DISCONNECT,
+    SENDER_REQUEST,
+    SENDER_NEW_GAME,
+    SENDER_SNAPSHOT
+};
+
+/*
+ * Command of the simulation thread to a sender. Connecting resets sending state of
+ * client in [slot]; a request asks for events of the current game from [first].
+ * A new snapshot of the current game replaces the previous one.
+ */
+struct sender_command_t {
+    sender_command_type type;
+    slot_t slot;
+    event_no_t first;
+    struct sockaddr_in6 address;
+    socklen_t address_len;
+    bool compact_events;
+    bool snapshots;
+    bool wide_events;
+    std::shared_ptr<const PublishedLog> log;
+    std::shared_ptr<const BoardSnapshot> snapshot;
+};
+
+/*
+ * Metrics of a single sender, summed into metrics of its server.
+ */
+struct sender_metrics_t {
+    MetricCounter sent_datagrams;
+    MetricCounter sent_bytes;
+    MetricCounter send_failures;
+    MetricCounter gso_saved_sends;
+    MetricCounter gso_bytes;
+    MetricCounter catch_up_suppressed_bytes;
+    MetricCounter catch_up_paced_bytes;
+    MetricCounter snapshot_parts;
+    MetricGauge waiting_messages;
+    MetricGauge payload_bytes;
+};
+
+/*
+ * Thread sending events of the published log to clients of slots assigned to it.
+ * It broadcasts events published by every tick, answers requests of its clients
+ * with catch-ups limited by their token buckets, and owns its own payload pool,
+ * batch and queue of datagrams waiting for the socket, so senders share nothing
+ * but the socket.
+ */
+class SenderThread {
+public:
+    SenderThread(int sock, size_t index, size_t count);
+    ~SenderThread();
+
+    SenderThread(const SenderThread &) = delete;
+    SenderThread &operator=(const SenderThread &) = delete;
+
+    void start();
+
+    /*
+     * Called by the simulation thread. Returns [false] if the command queue is full.
+     */
+    bool push(sender_command_t &command) {
+        return commands.try_push(command);
+    }
+
+    /*
+     * Called by the simulation thread after a tick published events.
+     */
+    void wake();
+
+    const sender_metrics_t &get_metrics() const {
+        return metrics;
+    }
+
+private:
+    struct client_t {
+        bool connected;
+        struct sockaddr_in6 address;
+        socklen_t address_len;
+        bool compact_events;
+        bool snapshots;
+        bool wide_events;
+        game_id_t cursor_game;
+        event_no_t sent_up_to;
+        uint64_t last_sent_ns;
+        bool catch_up_pending;
+        double tokens;
+        uint64_t tokens_updated_ns;
+        // Snapshot being sent to the client, from part [snapshot_part] on.
+        std::shared_ptr<const BoardSnapshot> snapshot;
+        size_t snapshot_part;
+    };
+
+    [[noreturn]] void run();
+
+    void handle(sender_command_t &command, uint64_t now);
+
+    client_t &get_client(slot_t slot);
+
+    /*
+     * Checks if [client] understands events of the game of [log].
+     */
+    bool gets_events(const client_t &client) const {
+        return client.wide_events || !log->is_wide();
+    }
+
+    void send_answer(client_t &client, event_no_t first, uint64_t now);
+
+    size_t send_catch_up(client_t &client, event_no_t first, uint64_t now);
+
+    /*
+     * Schedules datagrams with events from [next_event] to [last] (exclusive), advancing
+     * [next_event] and adding their length to [scheduled]. Returns [false] if the token
+     * bucket of the client ran out.
+     */
+    bool schedule_events(client_t &client, event_no_t &next_event, size_t last,
+                         size_t &scheduled);
+
+    /*
+     * Schedules remaining parts of the snapshot being sent to [client], adding their
+     * length to [scheduled]. Returns [false] if the token bucket of the client ran out.
+     */
+    bool schedule_snapshot(client_t &client, size_t &scheduled);
+
+    void broadcast(uint64_t now);
+
+    /*
+     * Fills [datagram], or the datagram of [compact_encoder] if [compact], with events
+     * from [first] to [last] (exclusive). Returns the filled datagram and saves number
+     * of the first event that did not fit to [next].
+     */
+    const Buffer &fill_datagram(bool compact, event_no_t first, size_t last, event_no_t &next);
+
+    void flush();
+
+    void publish_metrics();
+
+private:
+    int sock;
+    int wake_fd;
+    size_t index;
+    size_t count;
+    SpscRing<sender_command_t> commands;
+    // Indexed by slot divided by number of senders.
+    std::vector<client_t> clients;
+    std::shared_ptr<const PublishedLog> log;
+    // Events of [log] before it were broadcast.
+    size_t broadcast_up_to;
+    // Latest snapshot of the game of [log], or null.
+    std::shared_ptr<const BoardSnapshot> snapshot;
+    Buffer datagram;
+    CompactEncoder compact_encoder;
+    // Must outlive all holders of payload references declared below.
+    PayloadPool payload_pool;
+    SendBatch send_batch;
+    OutboundQueue waiting_messages;
+    uint64_t suppressed_bytes;
+    uint64_t paced_bytes;
+    uint64_t snapshot_parts;
+    sender_metrics_t metrics;
+};
+
+/*
+ * Sender threads of a server. Client in slot s is served by sender s mod count.
+ * All methods are called by the simulation thread, which never waits for a sender:
+ * commands that must not be lost but do not fit in a full queue are deferred until
+ * the sender makes room, and later commands of that sender queue up behind them.
+ */
+class SenderPool {
+public:
+    SenderPool() : dropped_requests(0) {}
+
+    bool empty() const {
+        return senders.empty();
+    }
+
+    /*
+     * Starts [count] senders sending through [sock].
+     */
+    void start(int sock, size_t count);
+
+    void connect(slot_t slot, const struct sockaddr_in6 &address, socklen_t address_len,
+                 bool compact_events, bool snapshots, bool wide_events);
+
+    void disconnect(slot_t slot);
+
+    /*
+     * Asks for events from [first] for client in [slot]. Requests that do not fit in
+     * a full command queue are dropped, as the client repeats them anyway.
+     */
+    void request(slot_t slot, event_no_t first);
+
+    void new_game(const std::shared_ptr<const PublishedLog> &log);
+
+    /*
+     * Hands completed [snapshot] of the current game to senders. All events it stands
+     * for must be published.
+     */
+    void new_snapshot(const std::shared_ptr<const BoardSnapshot> &snapshot);
+
+    void wake();
+
+    /*
+     * Sums metrics of senders into [server].
+     */
+    void collect_metrics(server_metrics_t &server) const;
+
+private:
+    /*
+     * Pushes command that must not be lost, deferring it if the queue is full.
+     */
+    void push(size_t sender, sender_command_t &command);
+
+    /*
+     * Pushes deferred commands of [sender] while its queue has room.
+     */
+    void push_deferred(size_t sender);
+
+private:
+    std::vector<std::unique_ptr<SenderThread>> senders;
+    // Commands that did not fit in the queue of each sender, oldest first.
+    std::vector<std::deque<sender_command_t>> deferred;
+    uint64_t dropped_requests;
+};
+
+#endif //SCREEN_WORMS_SENDER_POOL_H
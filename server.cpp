@@ -3,21 +3,49 @@
 #include <map>
 #include <zconf.h>
 #include <fcntl.h>
-#include <sys/timerfd.h>
 #include <cmath>
+#include <thread>
 
 #include "server_types.h"
 #include "server.h"
 #include "err.h"
 
-enum poll_elems {
-    SOCK = 0,
-    TIMER
-};
+namespace {
+    uint64_t monotonic_ns() {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return now.tv_sec * 1000000000ULL + now.tv_nsec;
+    }
+
+    void reset_catch_up(client_stats_t &client) {
+        client.cursor_game = 0;
+        client.sent_up_to = 0;
+        client.last_sent_ns = 0;
+        client.catch_up_pending = false;
+        client.tokens = CATCHUP_BURST_BYTES;
+        client.tokens_updated_ns = monotonic_ns();
+        client.snapshot.reset();
+        client.snapshot_part = 0;
+    }
+}
 
 Server::Server(server_params_t &p) : generator(p.generator_seed), params(p),
-        round_counter(0) {
-    for (int i = 0; i < 2; ++i) {
+        receive_ring(p.recv_batch_size), idle_clients(CLIENT_TIMEOUT_NS),
+        send_batch(payload_pool), uring_active(false), tick_stats{0, 0, 0}, catch_up_stats{0, 0, 0},
+        inputs(p.sender_threads > 0 ? INPUT_RING_SIZE : 1), published_games(0),
+        rejected_datagrams(0), next_upstream_report_ns(0) {
+    // Relay does not simulate games, so there is nothing to record.
+    if (!params.journal_path.empty() && params.upstream.empty())
+        journal.open(params.journal_path, params);
+    // Relay learns the board only from games of upstream, so it takes the largest one.
+    if (params.snapshot_interval > 0) {
+        if (params.upstream.empty())
+            snapshots.reserve(params.width, params.height);
+        else
+            snapshots.reserve(MAX_SCREEN_SIZE, MAX_SCREEN_SIZE);
+    }
+
+    for (int i = 0; i < POLL_SIZE; ++i) {
         poll_fds[i].fd = -1;
         poll_fds[i].events = POLLIN;
         poll_fds[i].revents = 0;
@@ -41,150 +69,473 @@ Server::Server(server_params_t &p) : generator(p.generator_seed), params(p),
     // Sets a sock to nonblocking mode.
     if (fcntl(sock, F_SETFL, O_NONBLOCK) < 0)
         syserr("fcntl");
-}
 
-bool Server::get_client_message(client_message &message, client_identity_t &identity) {
-    struct sockaddr_in6 client_address;
-    socklen_t client_address_len;
+    if (!params.upstream.empty()) {
+        upstream.connect(params.upstream);
+        poll_fds[UPSTREAM].fd = upstream.get_fd();
+    }
+}
 
-    ssize_t len = buffer.receive(poll_fds[SOCK].fd, client_address, client_address_len);
-    if (len <= 0)
+bool Server::admit_client(client_message &message,
+                          const struct sockaddr_in6 &client_address,
+                          socklen_t client_address_len, slot_t &slot) {
+    // Relay has no game to play in.
+    if (upstream.is_connected() && !message.player_name.empty())
         return false;
 
-    identity = {client_address.sin6_addr, client_address.sin6_port};
+    uint64_t now = monotonic_ns();
+    slot = sessions.find({client_address.sin6_addr, client_address.sin6_port});
 
-    // Valid data was received.
-    if (buffer.parse_client_message(message, len)) {
-        // Data received from already known client.
-        if (stats.find(identity) != stats.end()) {
-            if (stats[identity].session_id == message.session_id) {
-                stats[identity].round_counter = round_counter;
-                game_state.change_pressed_key(identity, message.turn_direction);
-            }
-            // New player connected from known address and port.
-            else if (stats[identity].session_id > message.session_id &&
-                    !game_state.player_name_in_use(message.player_name, identity)) {
-                stats[identity].session_id = message.session_id;
-                stats[identity].round_counter = round_counter;
-                stats[identity].address = client_address;
-                stats[identity].address_len = client_address_len;
-
-                game_state.change_player(identity, message);
-            }
-            else {
-                return false;
+    // Data received from already known client.
+    if (slot != NO_SLOT) {
+        client_stats_t &client = clients[slot];
+        if (client.session_id == message.session_id) {
+            idle_clients.touch(slot, now);
+            if (game_state.change_pressed_key(slot, message.turn_direction))
+                journal.pressed_key(slot, message.turn_direction);
+        }
+        // New player connected from known address and port.
+        else if (client.session_id > message.session_id && game_state.may_join(message, slot)) {
+            client.session_id = message.session_id;
+            idle_clients.touch(slot, now);
+            client.address = client_address;
+            client.address_len = client_address_len;
+            client.compact_events = message.compact_events;
+            client.snapshots = message.snapshots;
+            client.wide_events = message.wide_player_numbers;
+            reset_catch_up(client);
+            if (!senders.empty()) {
+                senders.connect(slot, client_address, client_address_len, client.compact_events,
+                                client.snapshots, client.wide_events);
             }
+
+            game_state.change_player(slot, message);
+            journal.change_player(slot, message);
         }
-        // Data received from new client.
         else {
-            if (stats.size() >= CLIENTS_COUNT ||
-                    game_state.player_name_in_use(message.player_name))
-                return false;
-
-            client_stats_t s = {.session_id = message.session_id, .round_counter = round_counter,
-                                .address = client_address, .address_len = client_address_len};
-            stats.insert({identity, s});
-            game_state.add_new_player(identity, message);
+            return false;
         }
+    }
+    // Data received from new client.
+    else {
+        if (sessions.size() >= params.max_clients || !game_state.may_join(message))
+            return false;
+
+        client_stats_t s{};
+        s.session_id = message.session_id;
+        s.address = client_address;
+        s.address_len = client_address_len;
+        s.compact_events = message.compact_events;
+        s.snapshots = message.snapshots;
+        s.wide_events = message.wide_player_numbers;
+        reset_catch_up(s);
+
+        slot = sessions.insert({client_address.sin6_addr, client_address.sin6_port});
+        if (slot >= clients.size())
+            clients.resize(slot + 1);
+        clients[slot] = s;
+        idle_clients.touch(slot, now);
+        if (!senders.empty())
+            senders.connect(slot, client_address, client_address_len, s.compact_events,
+                            s.snapshots, s.wide_events);
+
+        game_state.add_new_player(slot, message);
+        journal.add_player(slot, message);
+    }
+
+    return true;
+}
+
+void Server::receive_messages() {
+    size_t received = receive_ring.receive(poll_fds[SOCK].fd);
+
+    metrics.received_wakeups.add();
+    metrics.drained_per_wakeup.observe(received);
+
+    for (size_t i = 0; i < received; ++i) {
+        handle_datagram(receive_ring.get_buffer(i), receive_ring.get_length(i),
+                        receive_ring.get_address(i), receive_ring.get_address_len(i));
+    }
+
+    flush_send_batch();
+}
+
+void Server::handle_datagram(Buffer &buf, ssize_t len, const struct sockaddr_in6 &address,
+                             socklen_t address_len) {
+    client_message message;
+    slot_t slot;
+    metrics.received_datagrams.add();
+    metrics.received_bytes.add(std::max<ssize_t>(len, 0));
+    if (len <= 0 || !buf.parse_client_message(message, len))
+        malformed_datagrams.add();
+    // Client message is valid.
+    else if (admit_client(message, address, address_len, slot))
+        send_answer(message, slot);
+    else
+        ++rejected_datagrams;
+}
+
+void Server::send_answer(client_message &message, slot_t slot) {
+    auto &events = game_state.get_events();
+    auto &client = clients[slot];
+    uint64_t now = monotonic_ns();
+
+    // Cursor refers to events of a previous game.
+    if (client.cursor_game != game_state.get_game_id() || client.sent_up_to > events.get_size()) {
+        client.cursor_game = game_state.get_game_id();
+        client.sent_up_to = 0;
+        client.last_sent_ns = 0;
+    }
 
-        return true;
+    event_no_t first = message.next_expected_event_no;
+    if (first >= events.get_size() || !gets_events(client))
+        return;
+
+    // Requested range is still in flight, so only events after it are sent.
+    if (first < client.sent_up_to && now - client.last_sent_ns < CATCHUP_RESEND_INTERVAL_NS) {
+        catch_up_stats.suppressed_bytes += events.get_bytes_between(first, client.sent_up_to);
+        first = client.sent_up_to;
     }
 
-    return false;
+    send_catch_up(client, first, now);
 }
 
-void Server::send_answer(client_message &message, client_identity_t &identity) {
-    auto next_event = message.next_expected_event_no;
-    while (game_state.get_events().get_size() > next_event) {
-        Buffer buf;
-        buf.insert_number(game_state.get_game_id());
-        // Puts in datagram as many events as it can.
-        while (game_state.get_events().get_event(next_event) != nullptr &&
-                game_state.get_events().get_event(next_event)->get_event_length() <=
-                buf.get_space_left()) {
-            game_state.get_events().get_event(next_event)->stringify(buf, true);
-            ++next_event;
+size_t Server::send_catch_up(client_stats_t &client, event_no_t first, uint64_t now) {
+    auto &events = game_state.get_events();
+
+    // Refills token bucket.
+    client.tokens = std::min<double>(CATCHUP_BURST_BYTES, client.tokens +
+            double(now - client.tokens_updated_ns) * CATCHUP_BYTES_PER_SEC / 1e9);
+    client.tokens_updated_ns = now;
+
+    // Snapshot being sent no longer stands for any requested event.
+    if (client.snapshot != nullptr &&
+        (client.snapshot->get_game_id() != game_state.get_game_id() ||
+         first >= client.snapshot->get_watermark())) {
+        client.snapshot.reset();
+    }
+
+    const std::shared_ptr<const BoardSnapshot> &latest = snapshots.get_snapshot();
+    if (client.snapshot == nullptr && client.snapshots && latest != nullptr &&
+        latest->get_game_id() == game_state.get_game_id() && first < latest->get_watermark() &&
+        latest->get_bytes() < events.get_bytes_between(
+            std::max(first, latest->get_header_events()), latest->get_watermark())) {
+        client.snapshot = latest;
+        client.snapshot_part = 0;
+    }
+
+    size_t scheduled = 0;
+    event_no_t next_event = first;
+    client.catch_up_pending = false;
+    // Events announcing the game are followed by the snapshot standing for events up to
+    // its watermark.
+    bool done = true;
+    if (client.snapshot != nullptr) {
+        done = schedule_events(client, next_event, client.snapshot->get_header_events(),
+                               scheduled) && schedule_snapshot(client, scheduled);
+        if (done) {
+            next_event = std::max(next_event, client.snapshot->get_watermark());
+            client.snapshot.reset();
+        }
+    }
+    if (done)
+        schedule_events(client, next_event, events.get_size(), scheduled);
+
+    if (scheduled > 0)
+        client.last_sent_ns = now;
+    client.sent_up_to = next_event;
+
+    return scheduled;
+}
+
+bool Server::schedule_events(client_stats_t &client, event_no_t &next_event, size_t last,
+                             size_t &scheduled) {
+    auto &events = game_state.get_events();
+    while (std::min(last, events.get_size()) > next_event) {
+        event_no_t after;
+        const Buffer &buf = client.compact_events ?
+            compact_encoder.encode(events, game_state.get_game_id(), next_event, after, last) :
+            events.get_datagram(game_state.get_game_id(), next_event, after, last);
+        if (client.tokens < buf.get_length()) {
+            client.catch_up_pending = true;
+            return false;
         }
 
-        // Tries to send_to_client datagram to given client. If it fails, buffer with datagram
-        // is pushed into waiting messages queue.
-        buf.set_destination(stats[identity].address, stats[identity].address_len);
-        if (!waiting_messages.empty() || !buf.send_to_client(poll_fds[SOCK].fd)) {
-            waiting_messages.push(buf);
+        client.tokens -= buf.get_length();
+        scheduled += buf.get_length();
+        send_batch.add_destination(send_batch.add_payload(buf), client.address,
+                                   client.address_len);
+        next_event = after;
+    }
+
+    return true;
+}
+
+bool Server::schedule_snapshot(client_stats_t &client, size_t &scheduled) {
+    for (; client.snapshot_part < client.snapshot->get_part_count(); ++client.snapshot_part) {
+        const Buffer &buf = client.snapshot->get_part(client.snapshot_part);
+        if (client.tokens < buf.get_length()) {
+            client.catch_up_pending = true;
+            return false;
         }
+
+        client.tokens -= buf.get_length();
+        scheduled += buf.get_length();
+        ++catch_up_stats.snapshot_parts;
+        send_batch.add_destination(send_batch.add_payload(buf), client.address,
+                                   client.address_len);
+    }
+
+    return true;
+}
+
+void Server::pace_catch_ups() {
+    uint64_t now = monotonic_ns();
+    for (slot_t slot : sessions.get_live_slots()) {
+        client_stats_t &client = clients[slot];
+        if (client.catch_up_pending && client.cursor_game == game_state.get_game_id())
+            catch_up_stats.paced_bytes += send_catch_up(client, client.sent_up_to, now);
+        else
+            client.catch_up_pending = false;
     }
 }
 
 void Server::broadcast_messages() {
-    auto next_event = game_state.get_events().get_next_for_broadcast();
-    while (game_state.get_events().get_size() > next_event) {
-        Buffer buf;
-        buf.insert_number(game_state.get_game_id());
-        // Puts in datagram as many events as it can.
-        while (game_state.get_events().get_event(next_event) != nullptr &&
-                game_state.get_events().get_event(next_event)->get_event_length() <=
-                buf.get_space_left()) {
-            game_state.get_events().get_event(next_event)->stringify(buf, true);
-            ++next_event;
+    auto &events = game_state.get_events();
+    event_no_t first = events.get_next_for_broadcast();
+    // Every event is broadcast exactly once.
+    metrics.events.add(events.get_size() - first);
+
+    // Every encoding is packed only if some client asked for it.
+    bool legacy_clients = false, compact_clients = false;
+    if (events.get_size() > first) {
+        for (slot_t slot : sessions.get_live_slots()) {
+            if (!gets_events(clients[slot]))
+                continue;
+            if (clients[slot].compact_events)
+                compact_clients = true;
+            else
+                legacy_clients = true;
         }
+    }
 
-        // Tries to send_to_client datagram to all connected client. If it fails, buffer
-        // with datagram is pushed into waiting messages queue.
-        for (const auto& el : stats) {
-            auto identity = el.first;
-            buf.set_destination(stats[identity].address, stats[identity].address_len);
-            if (!waiting_messages.empty() || !buf.send_to_client(poll_fds[SOCK].fd)) {
-                waiting_messages.push(buf);
-            }
+    for (event_no_t next_event = first; legacy_clients && events.get_size() > next_event; ) {
+        const Buffer &buf = events.get_datagram(game_state.get_game_id(), next_event,
+                                                next_event);
+
+        // Datagram is stored once and addressed to all clients of its encoding.
+        size_t payload = send_batch.add_payload(buf);
+        for (slot_t slot : sessions.get_live_slots()) {
+            if (!clients[slot].compact_events && gets_events(clients[slot]))
+                send_batch.add_destination(payload, clients[slot].address,
+                                           clients[slot].address_len);
         }
     }
 
-    game_state.get_events().all_broadcasted();
+    for (event_no_t next_event = first; compact_clients && events.get_size() > next_event; ) {
+        const Buffer &buf = compact_encoder.encode(events, game_state.get_game_id(), next_event,
+                                                   next_event);
+
+        size_t payload = send_batch.add_payload(buf);
+        for (slot_t slot : sessions.get_live_slots()) {
+            if (clients[slot].compact_events && gets_events(clients[slot]))
+                send_batch.add_destination(payload, clients[slot].address,
+                                           clients[slot].address_len);
+        }
+    }
+
+    // Clients that were up to date got all new events with this broadcast.
+    for (slot_t slot : sessions.get_live_slots()) {
+        client_stats_t &client = clients[slot];
+        if (client.cursor_game == game_state.get_game_id() &&
+                client.sent_up_to >= events.get_next_for_broadcast())
+            client.sent_up_to = events.get_size();
+    }
+
+    events.all_broadcasted();
+    pace_catch_ups();
+    flush_send_batch();
+}
+
+void Server::flush_send_batch() {
+    if (uring_active) {
+        uring_loop.send_batch(send_batch);
+        return;
+    }
+
+    // Datagrams cannot overtake the ones already waiting.
+    if (waiting_messages.empty())
+        send_batch.flush(poll_fds[SOCK].fd);
+
+    send_batch.move_unsent(waiting_messages);
 }
 
 void Server::check_timeout() {
-    std::vector<client_identity_t> timeouted;
+    std::vector<slot_t> timeouted;
+    idle_clients.expire(monotonic_ns(), timeouted);
+
+    for (slot_t slot : timeouted) {
+        game_state.delete_player(slot);
+        journal.delete_player(slot);
+        sessions.erase(slot);
+        if (!senders.empty())
+            senders.disconnect(slot);
+    }
+}
 
-    for (auto it = stats.begin(); it != stats.end(); ++it) {
-        // Recent connection was at least 2 seconds ago.
-        if (round_counter - it->second.round_counter > 2 * params.rounds_per_second) {
-            client_identity_t id = it->first;
-            timeouted.push_back(id);
+void Server::run_due_rounds() {
+    // Every expiration missed because of a long tick gets its own round.
+    size_t due = scheduler.take_due_ticks(metrics);
+    for (size_t i = 0; i < due; ++i)
+        new_round();
+}
 
-            game_state.delete_player(id);
-        }
+void Server::new_round() {
+    uint64_t start = monotonic_ns();
+    if (!senders.empty())
+        drain_inputs();
+    uint64_t inputs_applied = monotonic_ns();
+    check_timeout();
+    uint64_t timeouts_checked = monotonic_ns();
+    if (upstream.is_connected()) {
+        upstream.request(game_state, timeouts_checked);
+        report_upstream_lag(timeouts_checked);
+    }
+    else {
+        game_state.new_round(params, generator);
+        journal.round(game_state.get_game_id(), game_state.get_events());
+    }
+    uint64_t round_done = monotonic_ns();
+    bool snapshot_built = params.snapshot_interval > 0 &&
+        snapshots.update(game_state.get_game_id(), game_state.get_events(),
+                         params.snapshot_interval);
+    uint64_t snapshot_done = monotonic_ns();
+    if (senders.empty()) {
+        broadcast_messages();
+    }
+    else {
+        publish_events();
+        // Snapshot is handed to senders once all events it stands for are published.
+        if (snapshot_built)
+            senders.new_snapshot(snapshots.get_snapshot());
+    }
+    uint64_t end = monotonic_ns();
+
+    uint64_t duration = end - start;
+    ++tick_stats.ticks;
+    tick_stats.total_ns += duration;
+    tick_stats.max_ns = std::max(tick_stats.max_ns, duration);
+    scheduler.record_duration(duration, metrics);
+
+    metrics.check_timeout_ns.observe(timeouts_checked - inputs_applied);
+    metrics.new_round_ns.observe(round_done - timeouts_checked);
+    if (params.snapshot_interval > 0)
+        metrics.snapshot_ns.observe(snapshot_done - round_done);
+    metrics.broadcast_ns.observe(end - snapshot_done);
+    metrics.tick_ns.observe(duration);
+    publish_metrics();
+}
+
+void Server::publish_metrics() {
+    metrics.invalid_datagrams.set(malformed_datagrams.get() + rejected_datagrams);
+    if (senders.empty()) {
+        const send_stats_t &batch = send_batch.get_send_stats();
+        const send_stats_t &queue = waiting_messages.get_send_stats();
+        const send_stats_t &uring = uring_loop.get_send_stats();
+        metrics.sent_datagrams.set(batch.datagrams + queue.datagrams + uring.datagrams);
+        metrics.sent_bytes.set(batch.bytes + queue.bytes + uring.bytes);
+        metrics.send_failures.set(batch.failures + queue.failures + uring.failures);
+        metrics.gso_saved_sends.set(send_batch.get_gso_stats().saved_calls);
+        metrics.gso_bytes.set(send_batch.get_gso_stats().bytes);
+        metrics.catch_up_suppressed_bytes.set(catch_up_stats.suppressed_bytes);
+        metrics.catch_up_paced_bytes.set(catch_up_stats.paced_bytes);
+        metrics.snapshot_parts.set(catch_up_stats.snapshot_parts);
+        metrics.waiting_messages.set(waiting_messages.get_descriptor_count());
+        metrics.payload_bytes.set(payload_pool.get_payload_bytes());
+    }
+    else {
+        senders.collect_metrics(metrics);
     }
 
-    for (auto &id: timeouted) {
-        stats.erase(id);
+    const tick_timing_stats_t &timing = scheduler.get_stats();
+    metrics.ticks.set(tick_stats.ticks);
+    metrics.missed_ticks.set(timing.missed_ticks);
+    metrics.dropped_ticks.set(timing.dropped_ticks);
+    metrics.games.set(game_state.get_games_started());
+    metrics.snapshots.set(snapshots.get_snapshots_built());
+
+    metrics.players.set(game_state.get_player_count());
+    metrics.spectators.set(sessions.size() - game_state.get_player_count());
+    metrics.worms.set(game_state.get_worm_count());
+    metrics.game_events.set(game_state.get_events().get_size());
+
+    if (upstream.is_connected()) {
+        uint64_t now = monotonic_ns();
+        metrics.upstream_events.set(upstream.get_stats().events);
+        metrics.upstream_events_behind.set(upstream.get_events_behind(game_state));
+        metrics.upstream_lag_ns.set(upstream.get_lag_ns(now));
     }
 }
 
+void Server::start() {
+    idle_clients.start(monotonic_ns());
+    scheduler.start(params.rounds_per_second, params.max_catch_up_ticks);
+    poll_fds[TIMER].fd = scheduler.get_fd();
+}
+
 [[noreturn]] void Server::run() {
+    start();
+
+    // Relay is driven by the poll loop only, as it waits for upstream too.
+    if (upstream.is_connected())
+        run_poll();
+    if (params.sender_threads > 0)
+        run_threaded();
+
+    if (params.use_io_uring) {
+        if (uring_loop.setup(poll_fds[SOCK].fd, poll_fds[TIMER].fd))
+            run_uring();
+        fprintf(stderr, "io_uring setup failed: %s, falling back to poll\n", strerror(errno));
+    }
+
+    run_poll();
+}
+
+short Server::get_socket_events() const {
+    // If some messages are to be sent, possibility of writing to socket should
+    // be examined.
+    return waiting_messages.empty() ? POLLIN : (POLLIN | POLLOUT);
+}
+
+void Server::process_events(short socket_revents, short timer_revents) {
+    // Round timer.
+    if (poll_fds[TIMER].fd != -1 && (timer_revents & POLLIN)) {
+        int64_t timer;
+        auto ret = read(poll_fds[TIMER].fd, &timer, 8);
+        if (ret != 8)
+            exit(EXIT_FAILURE);
+
+        run_due_rounds();
+    }
+    // Sends messages from [waiting_messages].
+    if ((socket_revents & POLLOUT) && !waiting_messages.empty()) {
+        waiting_messages.send_front(poll_fds[SOCK].fd);
+    }
+    // New clients' connections.
+    if ((socket_revents & POLLIN)) {
+        receive_messages();
+    }
+}
+
+[[noreturn]] void Server::run_poll() {
     int ret;
-    struct itimerspec round_timer;
-    // Sets and arms timer.
-    uint32_t miliseconds = 1000 / params.rounds_per_second;
-    round_timer.it_value.tv_sec = __time_t(1.0 / double(params.rounds_per_second));
-    round_timer.it_value.tv_nsec = 1000000 * (miliseconds % 1000);
-    round_timer.it_interval.tv_sec = __time_t(1.0 / double(params.rounds_per_second));
-    round_timer.it_interval.tv_nsec = 1000000 * (miliseconds % 1000);
-
-    int timer_fd = timerfd_create(CLOCK_REALTIME, 0);
-    if (timer_fd == -1)
-        syserr("timerfd");
-    if (timerfd_settime(timer_fd, 0, &round_timer, nullptr) == -1)
-        syserr("timerfd_settime");
-    poll_fds[TIMER].fd = timer_fd;
 
     while (true) {
         // Resets examined events.
         for (auto &i : poll_fds)
             i.revents = 0;
 
-        // If some messages are to be sent, possibility of writing to socket should
-        // be examined.
-        poll_fds[SOCK].events = waiting_messages.empty() ? POLLIN : (POLLIN | POLLOUT);
+        poll_fds[SOCK].events = get_socket_events();
 
         ret = poll(poll_fds, POLL_SIZE, -1);
         if (ret == -1) {
@@ -196,35 +547,149 @@ void Server::check_timeout() {
             continue;
         }
 
-        // Round timer.
-        if (poll_fds[TIMER].fd != -1 && (poll_fds[TIMER].revents & POLLIN)) {
-            int64_t timer;
-            auto ret = read(poll_fds[TIMER].fd, &timer, 8);
-            if (ret != 8)
-                exit(EXIT_FAILURE);
-
-            ++round_counter;
-            check_timeout();
-            game_state.new_round(params, generator);
-            broadcast_messages();
-        }
-        // Sends messages from [waiting_messages].
-        if ((poll_fds[SOCK].revents & POLLOUT)) {
-            Buffer buf = waiting_messages.front();
-            waiting_messages.pop();
-            if (!buf.send_to_client(poll_fds[SOCK].fd)) {
-                waiting_messages.push(buf);
+        process_events(poll_fds[SOCK].revents, poll_fds[TIMER].revents);
+        if (poll_fds[UPSTREAM].revents & POLLIN)
+            receive_upstream();
+    }
+}
+
+[[noreturn]] void Server::run_uring() {
+    uring_active = true;
+    Buffer buf;
+
+    while (true) {
+        // Submits datagrams queued during previous iteration and waits for events.
+        uring_loop.submit_and_wait();
+
+        size_t received = 0;
+        uring_completion_t completion;
+        while (uring_loop.next_completion(completion)) {
+            switch (completion.op) {
+                case URING_TIMER:
+                    if (completion.result != 8)
+                        exit(EXIT_FAILURE);
+                    run_due_rounds();
+                    break;
+                case URING_RECEIVE:
+                    if (completion.payload == nullptr)
+                        break;
+                    ++received;
+                    memcpy(buf.get_data(), completion.payload, completion.payload_len);
+                    uring_loop.recycle(completion);
+                    handle_datagram(buf, completion.payload_len, *completion.address,
+                                    completion.address_len);
+                    break;
+                case URING_SEND:
+                case URING_WRITABLE:
+                    break;
             }
         }
-        // New clients' connections.
-        if ((poll_fds[SOCK].revents & POLLIN)) {
-            client_message message;
-            client_identity_t identity;
-            // Client message is valid.
-            if (get_client_message(message, identity)) {
-                send_answer(message, identity);
+
+        if (received > 0) {
+            metrics.received_wakeups.add();
+            metrics.drained_per_wakeup.observe(received);
+        }
+        flush_send_batch();
+    }
+}
+
+void Server::drain_inputs() {
+    auto &events = game_state.get_events();
+    client_input_t input;
+    while (inputs.try_pop(input)) {
+        slot_t slot;
+        if (!admit_client(input.message, input.address, input.address_len, slot))
+            ++rejected_datagrams;
+        else if (input.message.next_expected_event_no < events.get_size())
+            senders.request(slot, input.message.next_expected_event_no);
+    }
+}
+
+void Server::publish_events() {
+    auto &events = game_state.get_events();
+    if (published_log == nullptr || published_games != game_state.get_games_started()) {
+        published_games = game_state.get_games_started();
+        published_log = std::make_shared<PublishedLog>(game_state.get_game_id(),
+                                                       game_state.has_wide_events());
+        senders.new_game(published_log);
+    }
+
+    // Every event is published exactly once.
+    metrics.events.add(events.get_size() - events.get_next_for_broadcast());
+    published_log->append(events, events.get_next_for_broadcast(), events.get_size());
+    published_log->publish();
+    events.all_broadcasted();
+}
+
+[[noreturn]] void Server::run_receiver() {
+    struct pollfd socket_events{poll_fds[SOCK].fd, POLLIN, 0};
+    while (true) {
+        socket_events.revents = 0;
+        if (poll(&socket_events, 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            syserr("poll");
+        }
+
+        size_t received = receive_ring.receive(poll_fds[SOCK].fd);
+        metrics.received_wakeups.add();
+        metrics.drained_per_wakeup.observe(received);
+
+        for (size_t i = 0; i < received; ++i) {
+            ssize_t len = receive_ring.get_length(i);
+            metrics.received_datagrams.add();
+            metrics.received_bytes.add(std::max<ssize_t>(len, 0));
+
+            client_input_t input;
+            if (len <= 0 || !receive_ring.get_buffer(i).parse_client_message(input.message, len)) {
+                malformed_datagrams.add();
+                continue;
             }
+            input.address = receive_ring.get_address(i);
+            input.address_len = receive_ring.get_address_len(i);
+            if (!inputs.try_push(input))
+                metrics.dropped_inputs.add();
         }
     }
 }
 
+[[noreturn]] void Server::run_threaded() {
+    senders.start(poll_fds[SOCK].fd, params.sender_threads);
+    std::thread receiver(&Server::run_receiver, this);
+    pthread_setname_np(receiver.native_handle(), "sw-io");
+    receiver.detach();
+
+    while (true) {
+        // Round timer is the only thing the simulation thread waits for.
+        uint64_t expirations;
+        ssize_t ret = read(poll_fds[TIMER].fd, &expirations, sizeof(expirations));
+        if (ret != sizeof(expirations)) {
+            if (ret == -1 && errno == EINTR)
+                continue;
+            exit(EXIT_FAILURE);
+        }
+
+        run_due_rounds();
+        senders.wake();
+    }
+}
+
+void Server::receive_upstream() {
+    if (upstream.receive(game_state, monotonic_ns(), metrics) > 0)
+        broadcast_messages();
+}
+
+void Server::report_upstream_lag(uint64_t now) {
+    if (now < next_upstream_report_ns)
+        return;
+    if (next_upstream_report_ns != 0) {
+        const upstream_stats_t &stats = upstream.get_stats();
+        fprintf(stderr, "relay of %s: %zu events behind, lag %.1f ms, max delay %.1f ms, "
+                "game %u, %lu events mirrored, %lu stale, %lu early, %lu malformed datagrams\n",
+                params.upstream.c_str(), upstream.get_events_behind(game_state),
+                upstream.get_lag_ns(now) / 1e6, upstream.take_max_delay_ns() / 1e6,
+                game_state.get_game_id(), stats.events, stats.stale_events,
+                stats.early_events, stats.malformed);
+    }
+    next_upstream_report_ns = now + RELAY_REPORT_INTERVAL_NS;
+}
@@ -3,67 +3,337 @@
 
 #include <pthread.h>
 #include <unordered_map>
-#include <queue>
 #include <poll.h>
 
 #include "server_types.h"
 #include "game_state.h"
 #include "random_generator.h"
+#include "receive_ring.h"
+#include "payload_pool.h"
+#include "outbound_queue.h"
+#include "send_batch.h"
+#include "uring_loop.h"
+#include "tick_scheduler.h"
+#include "session_table.h"
+#include "idle_wheel.h"
+#include "input_journal.h"
+#include "metrics.h"
+#include "spsc_ring.h"
+#include "published_log.h"
+#include "sender_pool.h"
+#include "upstream_link.h"
+#include "compact_events.h"
+#include "board_snapshot.h"
 
-#define POLL_SIZE   2
-#define CLIENTS_COUNT   25
+#define POLL_SIZE   3
+// Default limit of connected clients, as required by the game specification.
+#define DEFAULT_MAX_CLIENTS 25
+// Player numbers of wide events are 16-bit.
+#define MAX_CLIENTS         65535
+// Clients that send nothing for that long are disconnected.
+#define CLIENT_TIMEOUT_NS   2000000000ULL
+// Decoded datagrams waiting for the simulation thread in threaded mode.
+#define INPUT_RING_SIZE     8192
 
-using client_identity_t = std::pair<struct in6_addr, in_port_t>;
+enum poll_elems {
+    SOCK = 0,
+    TIMER,
+    // Socket connected to upstream in relay mode.
+    UPSTREAM
+};
 
 struct client_stats_t {
     session_id_t session_id;
-    round_counter_t round_counter;
+    struct sockaddr_in6 address;
+    socklen_t address_len;
+    // Events are sent in compact datagrams, as asked for by the first message of the session.
+    bool compact_events;
+    // Catch-ups may replace events with a board snapshot, as asked for by the first message.
+    bool snapshots;
+    // Client understands wide events; otherwise it gets no events of a wide game.
+    bool wide_events;
+    // Events of game [cursor_game] before [sent_up_to] were already sent to the client,
+    // most recently at [last_sent_ns].
+    game_id_t cursor_game;
+    event_no_t sent_up_to;
+    uint64_t last_sent_ns;
+    // Catch-up was cut by the byte budget and continues in following rounds.
+    bool catch_up_pending;
+    double tokens;
+    uint64_t tokens_updated_ns;
+    // Snapshot being sent to the client, from part [snapshot_part] on.
+    std::shared_ptr<const BoardSnapshot> snapshot;
+    size_t snapshot_part;
+};
+
+/*
+ * Decoded client message passed from the I/O thread to the simulation thread.
+ */
+struct client_input_t {
+    client_message message;
     struct sockaddr_in6 address;
     socklen_t address_len;
 };
 
+/*
+ * Catch-up bytes not sent because the range was already in flight, bytes sent by
+ * the pacer in rounds following the request, and snapshot parts sent.
+ */
+struct catch_up_stats_t {
+    uint64_t suppressed_bytes;
+    uint64_t paced_bytes;
+    uint64_t snapshot_parts;
+};
+
+/*
+ * Durations of [new_round] calls.
+ */
+struct tick_stats_t {
+    uint64_t ticks;
+    uint64_t total_ns;
+    uint64_t max_ns;
+};
+
 class Server {
 public:
     Server(server_params_t &p);
 
     [[noreturn]] void run();
 
+    /*
+     * Creates and arms round timer. Must be called once before [process_events]
+     * when the server is driven by an external event loop.
+     */
+    void start();
+
+    int get_socket_fd() const {
+        return poll_fds[SOCK].fd;
+    }
+
+    int get_timer_fd() const {
+        return poll_fds[TIMER].fd;
+    }
+
+    int get_port() const {
+        return params.port;
+    }
+
+    const tick_stats_t &get_tick_stats() const {
+        return tick_stats;
+    }
+
+    const tick_timing_stats_t &get_tick_timing_stats() const {
+        return scheduler.get_stats();
+    }
+
+    const catch_up_stats_t &get_catch_up_stats() const {
+        return catch_up_stats;
+    }
+
+    /*
+     * Number of datagrams waiting for the socket to become writable.
+     */
+    size_t get_queued_descriptors() const {
+        return waiting_messages.get_descriptor_count();
+    }
+
+    /*
+     * Bytes of outbound payloads that are still referenced.
+     */
+    size_t get_payload_bytes() const {
+        return payload_pool.get_payload_bytes();
+    }
+
+    const gso_stats_t &get_gso_stats() const {
+        return send_batch.get_gso_stats();
+    }
+
+    /*
+     * Live metrics; may be read from other threads while the server runs.
+     */
+    const server_metrics_t &get_metrics() const {
+        return metrics;
+    }
+
+    /*
+     * Returns poll events that should be examined on the socket.
+     */
+    short get_socket_events() const;
+
+    /*
+     * Handles events reported by poll on the socket and the round timer.
+     */
+    void process_events(short socket_revents, short timer_revents);
+
 private:
 
+    [[noreturn]] void run_poll();
+
+    [[noreturn]] void run_uring();
+
+    /*
+     * Threaded mode: the calling thread simulates rounds, an I/O thread receives and
+     * decodes datagrams into [inputs], and sender threads answer clients from
+     * the published event log, so tick timing does not depend on network load.
+     */
+    [[noreturn]] void run_threaded();
+
     /*
-     * Reads message from client and parses it.
-     * Returns [true] on success and [false] otherwise.
+     * Body of the I/O thread of threaded mode.
      */
-    bool get_client_message(client_message &message, client_identity_t &identity);
+    [[noreturn]] void run_receiver();
 
     /*
-     * Sends answer to client message.
-     * If message cannot be sent, it is pushed into waiting messages queue.
+     * Applies decoded [message] received from [client_address] to sessions and game
+     * state and saves slot of the client to [slot]. Returns [true] if the message
+     * was accepted and should be answered.
      */
-    void send_answer(client_message &message, client_identity_t &identity);
+    bool admit_client(client_message &message, const struct sockaddr_in6 &client_address,
+                      socklen_t client_address_len, slot_t &slot);
 
     /*
-     * Sends datagrams with events that were not sent yet to all clients.
-     * If messages cannot be sent, they are pushed into waiting messages queue.
+     * Applies inputs decoded by the I/O thread and forwards their requests for events
+     * to senders.
+     */
+    void drain_inputs();
+
+    /*
+     * Copies new events to the published log read by senders.
+     */
+    void publish_events();
+
+    /*
+     * Relay mode: mirrors events received from upstream and broadcasts them at once.
+     */
+    void receive_upstream();
+
+    /*
+     * Relay mode: prints lag behind upstream to stderr.
+     */
+    void report_upstream_lag(uint64_t now);
+
+    /*
+     * Drains a batch of datagrams from socket and answers all valid ones.
+     */
+    void receive_messages();
+
+    /*
+     * Parses a single received datagram and schedules answer to it.
+     */
+    void handle_datagram(Buffer &buf, ssize_t len, const struct sockaddr_in6 &address,
+                         socklen_t address_len);
+
+    /*
+     * Runs rounds that are due after the round timer expired.
+     */
+    void run_due_rounds();
+
+    /*
+     * Performs all periodic actions of a single round.
+     */
+    void new_round();
+
+    /*
+     * Checks if [client] understands events of the current game.
+     */
+    bool gets_events(const client_stats_t &client) const {
+        return client.wide_events || !game_state.has_wide_events();
+    }
+
+    /*
+     * Schedules answer to client message in [send_batch]. Events that were sent to the
+     * client recently are skipped, and the rest is limited by client's byte budget.
+     */
+    void send_answer(client_message &message, slot_t slot);
+
+    /*
+     * Schedules datagrams with events starting from [first] to given client while its
+     * token bucket allows. Events covered by a board snapshot are replaced with it if
+     * the client accepts one and the snapshot is smaller. Returns number of scheduled
+     * bytes.
+     */
+    size_t send_catch_up(client_stats_t &client, event_no_t first, uint64_t now);
+
+    /*
+     * Schedules datagrams with events from [next_event] to [last] (exclusive) to given
+     * client, advancing [next_event] and adding their length to [scheduled]. Returns
+     * [false] if the token bucket of the client ran out.
+     */
+    bool schedule_events(client_stats_t &client, event_no_t &next_event, size_t last,
+                         size_t &scheduled);
+
+    /*
+     * Schedules remaining parts of the snapshot being sent to given client, adding their
+     * length to [scheduled]. Returns [false] if the token bucket of the client ran out.
+     */
+    bool schedule_snapshot(client_stats_t &client, size_t &scheduled);
+
+    /*
+     * Continues catch-ups that were cut by byte budget.
+     */
+    void pace_catch_ups();
+
+    /*
+     * Sends datagrams with events that were not sent yet to all clients, in the
+     * encoding every client asked for. If messages cannot be sent, they are pushed
+     * into waiting messages queue.
      */
     void broadcast_messages();
 
+    /*
+     * Sends datagrams scheduled in [send_batch]. Datagrams that cannot be sent
+     * are pushed into waiting messages queue.
+     */
+    void flush_send_batch();
+
 
     /*
-     * Disconnects all the clients who did not send_to_client any message during last
-     * two seconds.
+     * Disconnects all the clients who did not send any message during last
+     * [CLIENT_TIMEOUT_NS].
      */
     void check_timeout();
 
+    /*
+     * Mirrors statistics of server's modules into [metrics].
+     */
+    void publish_metrics();
+
 private:
     RandomGenerator generator;
     server_params_t params;
     GameState game_state;
-    struct pollfd poll_fds[2];
-    Buffer buffer;
-    std::map<client_identity_t, client_stats_t, IdentityComparator> stats;
-    std::queue<Buffer> waiting_messages;
-    round_counter_t round_counter;
+    InputJournal journal;
+    struct pollfd poll_fds[POLL_SIZE];
+    ReceiveRing receive_ring;
+    SessionTable sessions;
+    // Indexed by client slot; valid for slots in use only.
+    std::vector<client_stats_t> clients;
+    // Expiry deadlines of connected clients, postponed by every valid message.
+    IdleWheel idle_clients;
+    // Must outlive all holders of payload references declared below.
+    PayloadPool payload_pool;
+    SendBatch send_batch;
+    OutboundQueue waiting_messages;
+    CompactEncoder compact_encoder;
+    SnapshotBuilder snapshots;
+    UringLoop uring_loop;
+    bool uring_active;
+    TickScheduler scheduler;
+    tick_stats_t tick_stats;
+    catch_up_stats_t catch_up_stats;
+    // Threaded mode only.
+    SpscRing<client_input_t> inputs;
+    SenderPool senders;
+    std::shared_ptr<PublishedLog> published_log;
+    uint64_t published_games;
+    // Datagrams that could not be decoded, counted by the thread decoding them, and
+    // decoded messages that were rejected.
+    MetricCounter malformed_datagrams;
+    uint64_t rejected_datagrams;
+    // Relay mode only.
+    UpstreamLink upstream;
+    uint64_t next_upstream_report_ns;
+    server_metrics_t metrics;
 };
 
 
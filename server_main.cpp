@@ -2,9 +2,8 @@
 #include <getopt.h>
 #include "server_types.h"
 #include "server.h"
-
-#define MIN_SCREEN_SIZE 16
-#define MAX_SCREEN_SIZE 4096
+#include "arena_pool.h"
+#include "metrics.h"
 
 void fill_with_default_values(server_params_t *p) {
     p->port = 2021;
@@ -12,14 +11,21 @@ void fill_with_default_values(server_params_t *p) {
     p->rounds_per_second = 50;
     p->width = 640;
     p->height = 480;
+    p->recv_batch_size = DEFAULT_RECV_BATCH_SIZE;
+    p->use_io_uring = false;
+    p->max_catch_up_ticks = DEFAULT_MAX_CATCH_UP_TICKS;
+    p->max_clients = DEFAULT_MAX_CLIENTS;
+    p->sender_threads = 0;
+    p->snapshot_interval = 0;
 }
 
-void get_options(server_params_t *p, int argc, char *argv[]) {
+void get_options(server_params_t *p, std::string &arena_config, std::string &metrics_path,
+                 int argc, char *argv[]) {
     bool seed_set = false;
     int opt;
 
     fill_with_default_values(p);
-    while ((opt = getopt(argc, argv, "p:s:t:v:w:h:")) != -1) {
+    while ((opt = getopt(argc, argv, "p:s:t:v:w:h:b:uc:m:l:j:M:T:r:S:")) != -1) {
         switch (opt) {
             case 'p':
                 p->port = strtol(optarg, nullptr, 10);
@@ -52,8 +58,49 @@ void get_options(server_params_t *p, int argc, char *argv[]) {
                 if (errno != 0 || p->height < MIN_SCREEN_SIZE || p->height > MAX_SCREEN_SIZE)
                     exit(EXIT_FAILURE);
                 break;
+            case 'b':
+                p->recv_batch_size = strtol(optarg, nullptr, 10);
+                if (errno != 0 || p->recv_batch_size < 1 ||
+                        p->recv_batch_size > MAX_RECV_BATCH_SIZE)
+                    exit(EXIT_FAILURE);
+                break;
+            case 'u':
+                p->use_io_uring = true;
+                break;
+            case 'c':
+                arena_config = optarg;
+                break;
+            case 'm':
+                p->max_catch_up_ticks = strtol(optarg, nullptr, 10);
+                if (errno != 0 || p->max_catch_up_ticks > MAX_CATCH_UP_TICKS)
+                    exit(EXIT_FAILURE);
+                break;
+            case 'l':
+                p->max_clients = strtol(optarg, nullptr, 10);
+                if (errno != 0 || p->max_clients < 1 || p->max_clients > MAX_CLIENTS)
+                    exit(EXIT_FAILURE);
+                break;
+            case 'j':
+                p->journal_path = optarg;
+                break;
+            case 'M':
+                metrics_path = optarg;
+                break;
+            case 'r':
+                p->upstream = optarg;
+                break;
+            case 'T':
+                p->sender_threads = strtol(optarg, nullptr, 10);
+                if (errno != 0 || p->sender_threads < 1 || p->sender_threads > MAX_SENDER_THREADS)
+                    exit(EXIT_FAILURE);
+                break;
+            case 'S':
+                p->snapshot_interval = strtol(optarg, nullptr, 10);
+                if (errno != 0 || p->snapshot_interval > MAX_SNAPSHOT_INTERVAL)
+                    exit(EXIT_FAILURE);
+                break;
             default:
-                fprintf(stderr, "Usage: %s [-p n] [-s n] [-t n] [-v n] [-w n] [-h n]\n",
+                fprintf(stderr, "Usage: %s [-p n] [-s n] [-t n] [-v n] [-w n] [-h n] [-b n] [-u] [-c file] [-m n] [-l n] [-j file] [-M socket] [-T n] [-r host:port] [-S n]\n",
                         argv[0]);
                 exit(EXIT_FAILURE);
         }
@@ -68,9 +115,26 @@ void get_options(server_params_t *p, int argc, char *argv[]) {
 
 int main(int argc, char *argv[]) {
     server_params_t p;
+    std::string arena_config;
+    std::string metrics_path;
+    MetricsExporter exporter;
+
+    get_options(&p, arena_config, metrics_path, argc, argv);
+    // Multi-arena mode.
+    if (!arena_config.empty()) {
+        ArenaPool pool{load_arena_config(arena_config, p)};
+        if (!metrics_path.empty()) {
+            pool.export_metrics(exporter);
+            exporter.start(metrics_path);
+        }
+        pool.run();
+    }
 
-    get_options(&p, argc, argv);
     Server server{p};
+    if (!metrics_path.empty()) {
+        exporter.add_server(server.get_port(), server.get_metrics());
+        exporter.start(metrics_path);
+    }
     server.run();
 
     return 0;
@@ -1,26 +1,50 @@
 #ifndef SCREEN_WORMS_SERVER_TYPES_H
 #define SCREEN_WORMS_SERVER_TYPES_H
 
+#include <cstdint>
 #include <netinet/in.h>
 #include <string.h>
+#include <string>
+
+#define MIN_SCREEN_SIZE 16
+#define MAX_SCREEN_SIZE 4096
 
 using coordinate_t = uint32_t;
 using pixel_t = std::pair<coordinate_t, coordinate_t>;
 using game_id_t = uint32_t;
 using turn_direction_t = uint8_t;
 using client_identity_t = std::pair<struct in6_addr, in_port_t>;
-using player_number_t = uint8_t;
+using player_number_t = uint16_t;
 using round_counter_t = uint64_t;
+// Index of a connected client in dense per-client arrays.
+using slot_t = uint32_t;
 
-struct IdentityComparator {
-    using is_transparent = void;
+#define NO_SLOT UINT32_MAX
 
-    bool operator()(const client_identity_t &id1, const client_identity_t &id2) const {
-        if (id1.second == id2.second) {
-            return memcmp(id1.first.s6_addr, id2.first.s6_addr, 16);
-        }
+// A range of events already sent to a client is not sent again earlier than that.
+#define CATCHUP_RESEND_INTERVAL_NS  200000000ULL
+// Token bucket limiting catch-up traffic sent to a single client.
+#define CATCHUP_BYTES_PER_SEC       (256 * 1024)
+#define CATCHUP_BURST_BYTES         (32 * 1024)
 
-        return id1.second < id2.second;
+struct IdentityHash {
+    size_t operator()(const client_identity_t &id) const {
+        uint64_t high, low;
+        memcpy(&high, id.first.s6_addr, sizeof(high));
+        memcpy(&low, id.first.s6_addr + sizeof(high), sizeof(low));
+
+        // Mixes address halves and port with splitmix64 finalizer.
+        uint64_t h = high * 0x9E3779B97F4A7C15ULL ^ (low + id.second);
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+        return h ^ (h >> 31);
+    }
+};
+
+struct IdentityEqual {
+    bool operator()(const client_identity_t &id1, const client_identity_t &id2) const {
+        return id1.second == id2.second &&
+            memcmp(id1.first.s6_addr, id2.first.s6_addr, sizeof(id1.first.s6_addr)) == 0;
     }
 };
 
@@ -31,6 +55,19 @@ struct server_params_t {
     round_counter_t rounds_per_second;
     coordinate_t width;
     coordinate_t height;
+    size_t recv_batch_size;
+    bool use_io_uring;
+    size_t max_catch_up_ticks;
+    size_t max_clients;
+    // Inputs of the game are recorded to this file unless it is empty.
+    std::string journal_path;
+    // Network I/O, simulation and sending run on separate threads if not zero.
+    size_t sender_threads;
+    // Relay mode: host:port of the server whose games are mirrored to spectators.
+    std::string upstream;
+    // Board snapshot is built every that many events for clients that accept one,
+    // unless it is zero.
+    size_t snapshot_interval;
 };
 
 struct worm_position_t {
@@ -48,7 +85,7 @@ enum direction {
 enum player_category {
     ACTIVE,
     SPECTATOR,
-    DISCONNECTED
+    VACANT
 };
 
 enum game_phase {
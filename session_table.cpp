@@ -0,0 +1,85 @@
+#include <algorithm>
+
+#include "session_table.h"
+
+namespace {
+    constexpr size_t MIN_BUCKETS = 64;
+}
+
+slot_t SessionTable::find(const client_identity_t &identity) const {
+    if (buckets.empty())
+        return NO_SLOT;
+
+    IdentityEqual equal;
+    for (size_t i = home(identity); buckets[i] != NO_SLOT; i = (i + 1) & mask) {
+        if (equal(identities[buckets[i]], identity))
+            return buckets[i];
+    }
+
+    return NO_SLOT;
+}
+
+slot_t SessionTable::insert(const client_identity_t &identity) {
+    // Keeps load factor at most 1/2, so probe sequences stay short.
+    if (2 * (live_slots.size() + 1) > buckets.size())
+        rehash(std::max(MIN_BUCKETS, 2 * buckets.size()));
+
+    slot_t slot;
+    if (free_slots.empty()) {
+        slot = identities.size();
+        identities.push_back(identity);
+        live_index.push_back(NO_SLOT);
+    }
+    else {
+        slot = free_slots.back();
+        free_slots.pop_back();
+        identities[slot] = identity;
+    }
+
+    size_t i = home(identity);
+    while (buckets[i] != NO_SLOT)
+        i = (i + 1) & mask;
+    buckets[i] = slot;
+
+    live_index[slot] = live_slots.size();
+    live_slots.push_back(slot);
+    return slot;
+}
+
+void SessionTable::erase(slot_t slot) {
+    size_t hole = home(identities[slot]);
+    while (buckets[hole] != slot)
+        hole = (hole + 1) & mask;
+
+    // Shifts following entries of the probe sequence back, so no tombstones are needed.
+    for (size_t i = (hole + 1) & mask; buckets[i] != NO_SLOT; i = (i + 1) & mask) {
+        size_t wanted = home(identities[buckets[i]]);
+        bool movable = hole <= i ? (wanted <= hole || wanted > i) : (wanted <= hole && wanted > i);
+        if (movable) {
+            buckets[hole] = buckets[i];
+            hole = i;
+        }
+    }
+    buckets[hole] = NO_SLOT;
+
+    // Removes slot from [live_slots] by swapping it with the last one.
+    slot_t position = live_index[slot];
+    live_slots[position] = live_slots.back();
+    live_index[live_slots[position]] = position;
+    live_slots.pop_back();
+    live_index[slot] = NO_SLOT;
+
+    free_slots.push_back(slot);
+}
+
+void SessionTable::rehash(size_t capacity) {
+    buckets.assign(capacity, NO_SLOT);
+    mask = capacity - 1;
+
+    for (slot_t slot : live_slots) {
+        size_t i = home(identities[slot]);
+        while (buckets[i] != NO_SLOT)
+            i = (i + 1) & mask;
+        buckets[i] = slot;
+    }
+}
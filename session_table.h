@@ -0,0 +1,69 @@
+#ifndef SCREEN_WORMS_SESSION_TABLE_H
+#define SCREEN_WORMS_SESSION_TABLE_H
+
+#include <vector>
+
+#include "server_types.h"
+
+/*
+ * Maps client identities to small integer slots. Slots of removed clients are reused,
+ * so per-client data can be kept in dense arrays indexed by slot. Identities are
+ * looked up in an open addressing hash table with linear probing.
+ */
+class SessionTable {
+public:
+    SessionTable() : mask(0) {}
+
+    /*
+     * Returns slot of given identity or [NO_SLOT] if it is unknown.
+     */
+    slot_t find(const client_identity_t &identity) const;
+
+    /*
+     * Assigns a free slot to an identity that is not in the table yet.
+     */
+    slot_t insert(const client_identity_t &identity);
+
+    void erase(slot_t slot);
+
+    size_t size() const {
+        return live_slots.size();
+    }
+
+    /*
+     * Number of slots ever assigned; all slots are below it.
+     */
+    size_t get_slot_limit() const {
+        return identities.size();
+    }
+
+    const client_identity_t &get_identity(slot_t slot) const {
+        return identities[slot];
+    }
+
+    /*
+     * Slots in use, in no particular order.
+     */
+    const std::vector<slot_t> &get_live_slots() const {
+        return live_slots;
+    }
+
+private:
+    size_t home(const client_identity_t &identity) const {
+        return IdentityHash()(identity) & mask;
+    }
+
+    void rehash(size_t capacity);
+
+private:
+    // Hash table of slots; [NO_SLOT] marks an empty bucket.
+    std::vector<slot_t> buckets;
+    size_t mask;
+    std::vector<client_identity_t> identities;
+    // Position of every slot in [live_slots] or [NO_SLOT] if it is free.
+    std::vector<slot_t> live_index;
+    std::vector<slot_t> live_slots;
+    std::vector<slot_t> free_slots;
+};
+
+#endif //SCREEN_WORMS_SESSION_TABLE_H
@@ -0,0 +1,283 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+
+#include "board_snapshot.h"
+#include "compact_events.h"
+#include "game_state.h"
+
+/*
+ * Plays games with random inputs over a few board sizes and player counts, follows
+ * them with a snapshot builder, as the server does once per round, and compares
+ * every completed snapshot with the events it stands for: their bytes in legacy and
+ * compact datagrams, which a late joiner would get instead. Every snapshot is decoded
+ * back and checked against the events. Builder steps are timed per round.
+ *
+ * Usage: snapshot-bench [-r rounds] [-i interval]
+ */
+namespace {
+    constexpr size_t DEFAULT_ROUNDS = 5000;
+    constexpr size_t DEFAULT_INTERVAL = 2000;
+    constexpr uint32_t SEED = 1;
+
+    struct config_t {
+        coordinate_t board;
+        size_t players;
+    };
+
+    struct result_t {
+        size_t snapshots;
+        size_t replaced_events;
+        size_t parts;
+        size_t snapshot_bytes;
+        size_t legacy_bytes;
+        size_t compact_bytes;
+        size_t steps;
+        double step_ns;
+        double max_step_ns;
+    };
+
+    class Bench {
+    public:
+        Bench(const config_t &config, size_t interval) : config(config), interval(interval),
+                result{} {}
+
+        result_t run(size_t rounds);
+
+    private:
+        /*
+         * Adds bytes of [snapshot] and of events it stands for to the result.
+         */
+        void measure(EventCollection &events, const BoardSnapshot &snapshot);
+
+        /*
+         * Checks that [snapshot] decodes to an image holding every pixel eaten by events
+         * before its watermark and only pixels eaten by some event, and to players
+         * eliminated before the watermark.
+         */
+        void verify(const EventCollection &events, const BoardSnapshot &snapshot);
+
+    private:
+        config_t config;
+        size_t interval;
+        result_t result;
+        SnapshotBuilder builder;
+        CompactEncoder encoder;
+        // Player number plus one of every pixel of the decoded image, 0 if not eaten.
+        std::vector<uint32_t> image;
+    };
+
+    double elapsed_ns(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - start).count();
+    }
+
+    uint32_t read_number(const char *data, size_t len) {
+        uint32_t n = 0;
+        for (size_t i = 0; i < len; ++i)
+            n = n << 8 | uint8_t(data[i]);
+        return n;
+    }
+
+    [[noreturn]] void fail(const BoardSnapshot &snapshot, const char *reason) {
+        fprintf(stderr, "snapshot of game %u at event %u: %s\n", snapshot.get_game_id(),
+                snapshot.get_watermark(), reason);
+        exit(EXIT_FAILURE);
+    }
+
+    void Bench::measure(EventCollection &events, const BoardSnapshot &snapshot) {
+        game_id_t game_id = snapshot.get_game_id();
+        event_no_t first = snapshot.get_header_events();
+        event_no_t last = snapshot.get_watermark();
+
+        ++result.snapshots;
+        result.replaced_events += last - first;
+        result.parts += snapshot.get_part_count();
+        result.snapshot_bytes += snapshot.get_bytes();
+        for (event_no_t next = first; next < last; )
+            result.legacy_bytes += events.get_datagram(game_id, next, next, last).get_length();
+        for (event_no_t next = first; next < last; )
+            result.compact_bytes += encoder.encode(events, game_id, next, next, last).get_length();
+    }
+
+    void Bench::verify(const EventCollection &events, const BoardSnapshot &snapshot) {
+        image.assign(size_t(config.board) * config.board, 0);
+        std::vector<bool> eliminated;
+        snapshot_part_t part;
+        for (size_t p = 0; p < snapshot.get_part_count(); ++p) {
+            const Buffer &buf = snapshot.get_part(p);
+            if (!is_snapshot_part(buf.get_data(), buf.get_length()) ||
+                !verify_snapshot_part(buf.get_data(), buf.get_length()) ||
+                !decode_snapshot_part(buf.get_data(), buf.get_length(), part)) {
+                fail(snapshot, "part does not decode");
+            }
+            if (part.game_id != snapshot.get_game_id() ||
+                part.watermark != snapshot.get_watermark() ||
+                part.header_events != snapshot.get_header_events() || part.part != p ||
+                part.parts != snapshot.get_part_count()) {
+                fail(snapshot, "part header does not match");
+            }
+
+            for (player_number_t number : part.eliminated) {
+                if (number >= eliminated.size())
+                    eliminated.resize(number + 1, false);
+                eliminated[number] = true;
+            }
+            for (const snapshot_run_t &run : part.runs) {
+                if (uint64_t(run.position) + run.length > image.size())
+                    fail(snapshot, "run is out of the board");
+                for (uint32_t i = run.position; i < run.position + run.length; ++i)
+                    image[i] = run.owner + 1;
+            }
+        }
+
+        // Pixels of the image are matched off by events that ate them.
+        std::vector<bool> matched(image.size(), false);
+        for (size_t e = 0; e < events.get_size(); ++e) {
+            const char *event = events.get_event_data(e);
+            event_type_t type = event[sizeof(event_len_t) + sizeof(event_no_t)];
+            const char *data = event + sizeof(event_len_t) + sizeof(event_no_t) +
+                sizeof(event_type_t);
+            bool before = e < snapshot.get_watermark();
+
+            if (type == PIXEL || type == WIDE_PIXEL) {
+                size_t number_len = type == PIXEL ? 1 : 2;
+                uint32_t number = read_number(data, number_len);
+                size_t position = read_number(data + number_len + 4, 4) * config.board +
+                    read_number(data + number_len, 4);
+                if (image[position] == number + 1)
+                    matched[position] = true;
+                else if (before)
+                    fail(snapshot, "pixel eaten before watermark is missing");
+            }
+            else if ((type == PLAYER_ELIMINATED || type == WIDE_PLAYER_ELIMINATED) && before) {
+                uint32_t number = read_number(data, type == PLAYER_ELIMINATED ? 1 : 2);
+                if (number >= eliminated.size() || !eliminated[number])
+                    fail(snapshot, "eliminated player is missing");
+                eliminated[number] = false;
+            }
+        }
+
+        for (size_t i = 0; i < image.size(); ++i) {
+            if (image[i] != 0 && !matched[i])
+                fail(snapshot, "pixel was not eaten by any event");
+        }
+        for (bool left : eliminated) {
+            if (left)
+                fail(snapshot, "player was not eliminated before watermark");
+        }
+    }
+
+    result_t Bench::run(size_t rounds) {
+        server_params_t params{};
+        params.width = config.board;
+        params.height = config.board;
+        params.turning_speed = 6;
+        params.rounds_per_second = 50;
+        RandomGenerator generator(SEED);
+        GameState game_state;
+        uint64_t random = SEED;
+        // Server reserves the image at start, out of ticks.
+        builder.reserve(config.board, config.board);
+
+        for (size_t i = 0; i < config.players; ++i) {
+            client_message message{};
+            message.session_id = i;
+            message.turn_direction = STRAIGHT;
+            message.wide_player_numbers = true;
+            message.player_name.assign("player" + std::to_string(i));
+            game_state.add_new_player(i, message);
+        }
+
+        for (size_t round = 0; round < rounds; ++round) {
+            // Keys change in about every tenth round; in a break all players press one.
+            for (size_t i = 0; i < config.players; ++i) {
+                random = random * 6364136223846793005ULL + 1442695040888963407ULL;
+                uint32_t bits = random >> 33;
+                if (!game_state.in_game())
+                    game_state.change_pressed_key(i, LEFT);
+                else if (bits % 10 == 0)
+                    game_state.change_pressed_key(i, turn_direction_t(bits / 10 % 3));
+            }
+
+            game_state.new_round(params, generator);
+            auto &events = game_state.get_events();
+            events.all_broadcasted();
+
+            auto start = std::chrono::steady_clock::now();
+            bool built = builder.update(game_state.get_game_id(), events, interval);
+            double step = elapsed_ns(start);
+            ++result.steps;
+            result.step_ns += step;
+            result.max_step_ns = std::max(result.max_step_ns, step);
+
+            if (built) {
+                measure(events, *builder.get_snapshot());
+                verify(events, *builder.get_snapshot());
+            }
+        }
+
+        return result;
+    }
+
+    void print(const config_t &config, const result_t &result) {
+        if (result.snapshots == 0) {
+            printf("%u,%zu,0,,,,,,,,,%.1f,%.1f\n", config.board, config.players,
+                   result.step_ns / result.steps / 1e3, result.max_step_ns / 1e3);
+            return;
+        }
+
+        auto per_snapshot = [&](size_t total) {
+            return double(total) / result.snapshots;
+        };
+
+        printf("%u,%zu,%zu,%.0f,%.1f,%.0f,%.0f,%.0f,%.2f,%.2f,%.1f,%.1f\n", config.board,
+               config.players, result.snapshots, per_snapshot(result.replaced_events),
+               per_snapshot(result.parts), per_snapshot(result.snapshot_bytes),
+               per_snapshot(result.legacy_bytes), per_snapshot(result.compact_bytes),
+               double(result.legacy_bytes) / result.snapshot_bytes,
+               double(result.compact_bytes) / result.snapshot_bytes,
+               result.step_ns / result.steps / 1e3, result.max_step_ns / 1e3);
+        fflush(stdout);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t rounds = DEFAULT_ROUNDS;
+    size_t interval = DEFAULT_INTERVAL;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:i:")) != -1) {
+        switch (opt) {
+            case 'r':
+                rounds = strtoul(optarg, nullptr, 10);
+                if (rounds == 0)
+                    exit(EXIT_FAILURE);
+                break;
+            case 'i':
+                interval = strtoul(optarg, nullptr, 10);
+                if (interval == 0 || interval > MAX_SNAPSHOT_INTERVAL)
+                    exit(EXIT_FAILURE);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-r rounds] [-i interval]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("board,players,snapshots,replaced_events,parts,snapshot_bytes,legacy_bytes,"
+           "compact_bytes,legacy_ratio,compact_ratio,mean_step_us,max_step_us\n");
+    fflush(stdout);
+
+    const coordinate_t boards[] = {64, 256, 1024, 4096};
+    const size_t player_counts[] = {2, 8, 25, 200, 1000};
+    for (coordinate_t board : boards) {
+        for (size_t players : player_counts) {
+            config_t config{board, players};
+            print(config, Bench(config, interval).run(rounds));
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef SCREEN_WORMS_SPSC_RING_H
+#define SCREEN_WORMS_SPSC_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Producer and consumer indices live on separate cache lines.
+#define CACHE_LINE_SIZE     64
+
+/*
+ * Bounded lock-free queue passing values from exactly one producer thread to exactly
+ * one consumer thread. Capacity is rounded up to a power of two. Each side caches the
+ * other side's index and reloads it only when the ring looks full or empty, so the
+ * shared cache lines are touched once per batch rather than once per value.
+ */
+template<typename T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) : head(0), cached_tail(0), tail(0), cached_head(0) {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing &) = delete;
+    SpscRing &operator=(const SpscRing &) = delete;
+
+    /*
+     * Called by the producer. Returns [false] if the ring is full; [value] is then
+     * left untouched.
+     */
+    bool try_push(T &value) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - cached_head == slots.size()) {
+            cached_head = head.load(std::memory_order_acquire);
+            if (t - cached_head == slots.size())
+                return false;
+        }
+
+        slots[t & mask] = std::move(value);
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /*
+     * Called by the consumer. Returns [false] if the ring is empty.
+     */
+    bool try_pop(T &value) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == cached_tail) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if (h == cached_tail)
+                return false;
+        }
+
+        value = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    // Written by the consumer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head;
+    size_t cached_tail;
+    // Written by the producer.
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail;
+    size_t cached_head;
+};
+
+#endif //SCREEN_WORMS_SPSC_RING_H
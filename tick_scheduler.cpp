@@ -0,0 +1,98 @@
+#include <ctime>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "tick_scheduler.h"
+#include "err.h"
+
+namespace {
+    constexpr uint64_t NS_PER_SEC = 1000000000ULL;
+
+    void add_to_histogram(uint64_t (&histogram)[TICK_HISTOGRAM_BUCKETS], uint64_t value_ns) {
+        size_t bucket = 0;
+        uint64_t bound = 10000;
+        while (bucket + 1 < TICK_HISTOGRAM_BUCKETS && value_ns >= bound) {
+            ++bucket;
+            bound *= 10;
+        }
+        ++histogram[bucket];
+    }
+}
+
+TickScheduler::TickScheduler() : timer_fd(-1), rounds_per_second(1), period_ns(NS_PER_SEC),
+        max_catch_up_ticks(0), start_ns(0), next_tick(1), stats{} {}
+
+TickScheduler::~TickScheduler() {
+    if (timer_fd != -1)
+        close(timer_fd);
+}
+
+uint64_t TickScheduler::now_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * NS_PER_SEC + now.tv_nsec;
+}
+
+void TickScheduler::start(uint64_t rps, size_t max_catch_up) {
+    rounds_per_second = rps;
+    period_ns = NS_PER_SEC / rps;
+    max_catch_up_ticks = max_catch_up;
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (timer_fd == -1)
+        syserr("timerfd");
+
+    start_ns = now_ns();
+    next_tick = 1;
+    arm();
+}
+
+uint64_t TickScheduler::deadline(uint64_t tick) const {
+    // Splits the product, so it does not overflow for any realistic uptime.
+    return start_ns + tick / rounds_per_second * NS_PER_SEC +
+        tick % rounds_per_second * NS_PER_SEC / rounds_per_second;
+}
+
+void TickScheduler::arm() {
+    uint64_t next = deadline(next_tick);
+
+    struct itimerspec round_timer{};
+    round_timer.it_value.tv_sec = next / NS_PER_SEC;
+    round_timer.it_value.tv_nsec = next % NS_PER_SEC;
+    if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &round_timer, nullptr) == -1)
+        syserr("timerfd_settime");
+}
+
+size_t TickScheduler::take_due_ticks(server_metrics_t &metrics) {
+    uint64_t now = now_ns();
+
+    size_t due = 0;
+    while (deadline(next_tick) <= now && due <= max_catch_up_ticks) {
+        uint64_t lateness = now - deadline(next_tick);
+        add_to_histogram(stats.lateness, lateness);
+        metrics.tick_lateness_ns.observe(lateness);
+        ++next_tick;
+        ++due;
+    }
+    if (due > 1)
+        stats.missed_ticks += due - 1;
+
+    // Ticks over the cap are skipped, so the game does not run in a burst.
+    if (deadline(next_tick) <= now) {
+        uint64_t first_future = (now - start_ns) / NS_PER_SEC * rounds_per_second +
+            (now - start_ns) % NS_PER_SEC * rounds_per_second / NS_PER_SEC + 1;
+        stats.dropped_ticks += first_future - next_tick;
+        next_tick = first_future;
+    }
+
+    arm();
+    return due;
+}
+
+void TickScheduler::record_duration(uint64_t duration_ns, server_metrics_t &metrics) {
+    if (duration_ns > period_ns) {
+        ++stats.overruns;
+        add_to_histogram(stats.overrun_excess, duration_ns - period_ns);
+        metrics.tick_overrun_ns.observe(duration_ns - period_ns);
+    }
+}
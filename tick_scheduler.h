@@ -0,0 +1,87 @@
+#ifndef SCREEN_WORMS_TICK_SCHEDULER_H
+#define SCREEN_WORMS_TICK_SCHEDULER_H
+
+#include <cstdint>
+#include <cstddef>
+
+#include "metrics.h"
+
+#define DEFAULT_MAX_CATCH_UP_TICKS  5
+#define MAX_CATCH_UP_TICKS          1000
+// Histogram bucket [i] counts values below 10^(i + 1) microseconds; the last one
+// counts all larger values.
+#define TICK_HISTOGRAM_BUCKETS      6
+
+/*
+ * Lateness of tick starts behind their deadlines, and excess of tick durations over
+ * the round period. Ticks run to catch up are counted in [missed_ticks], ticks over
+ * the catch-up cap are skipped and counted in [dropped_ticks].
+ */
+struct tick_timing_stats_t {
+    uint64_t missed_ticks;
+    uint64_t dropped_ticks;
+    uint64_t overruns;
+    uint64_t lateness[TICK_HISTOGRAM_BUCKETS];
+    uint64_t overrun_excess[TICK_HISTOGRAM_BUCKETS];
+};
+
+/*
+ * Round timer on CLOCK_MONOTONIC. Deadline of tick [k] is start + k / rounds per second,
+ * computed exactly in nanoseconds, so the period does not drift for any rate. The timer
+ * is armed one-shot at the absolute deadline of the next tick.
+ */
+class TickScheduler {
+public:
+    TickScheduler();
+    ~TickScheduler();
+
+    TickScheduler(const TickScheduler &) = delete;
+    TickScheduler &operator=(const TickScheduler &) = delete;
+
+    /*
+     * Creates timer and arms it for the first tick.
+     */
+    void start(uint64_t rounds_per_second, size_t max_catch_up_ticks);
+
+    int get_fd() const {
+        return timer_fd;
+    }
+
+    uint64_t get_period_ns() const {
+        return period_ns;
+    }
+
+    /*
+     * Must be called after the timer expired. Returns number of ticks that are due,
+     * at most [max_catch_up_ticks] + 1, and arms the timer for the next one. Lateness
+     * of due ticks is also recorded in [metrics].
+     */
+    size_t take_due_ticks(server_metrics_t &metrics);
+
+    /*
+     * Records duration of a single tick, and its overrun in [metrics].
+     */
+    void record_duration(uint64_t duration_ns, server_metrics_t &metrics);
+
+    const tick_timing_stats_t &get_stats() const {
+        return stats;
+    }
+
+    static uint64_t now_ns();
+
+private:
+    uint64_t deadline(uint64_t tick) const;
+    void arm();
+
+private:
+    int timer_fd;
+    uint64_t rounds_per_second;
+    uint64_t period_ns;
+    size_t max_catch_up_ticks;
+    uint64_t start_ns;
+    // Index of the first tick that did not run yet.
+    uint64_t next_tick;
+    tick_timing_stats_t stats;
+};
+
+#endif //SCREEN_WORMS_TICK_SCHEDULER_H
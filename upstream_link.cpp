@@ -0,0 +1,228 @@
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "upstream_link.h"
+#include "buffer.h"
+#include "err.h"
+
+namespace {
+    uint32_t read_number(const char *data) {
+        uint32_t n;
+        memcpy(&n, data, sizeof(n));
+        return be32toh(n);
+    }
+}
+
+UpstreamLink::UpstreamLink() : sock(-1), session_id(0), known_game(0), known_events(0),
+        previous_game(0), behind_since_ns(0), timed_game(0), timed_event(0), timed_since_ns(0),
+        max_delay_ns(0), stats{0, 0, 0, 0, 0, 0} {}
+
+UpstreamLink::~UpstreamLink() {
+    if (sock >= 0)
+        close(sock);
+}
+
+void UpstreamLink::connect(const std::string &address) {
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos || colon == 0 || colon + 1 == address.size())
+        fatal("upstream must be given as host:port: %s", address.c_str());
+    std::string host = address.substr(0, colon);
+    std::string port = address.substr(colon + 1);
+    // IPv6 address may be given in brackets.
+    if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+
+    struct addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    struct addrinfo *upstream;
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &upstream) != 0)
+        fatal("cannot resolve upstream %s", address.c_str());
+
+    sock = socket(upstream->ai_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0)
+        syserr("socket");
+    // Connected socket receives datagrams of upstream only.
+    if (::connect(sock, upstream->ai_addr, upstream->ai_addrlen) < 0)
+        syserr("connect to upstream %s", address.c_str());
+    freeaddrinfo(upstream);
+    // Kernel marks every datagram with its arrival time.
+    int on = 1;
+    if (setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) < 0)
+        syserr("setsockopt");
+
+    // Session id is the connection time in microseconds, as for other clients.
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    session_id = now.tv_sec * 1000000ULL + now.tv_nsec / 1000;
+}
+
+size_t UpstreamLink::get_events_behind(const GameState &game_state) const {
+    // Some events of a game that is not mirrored yet exist upstream.
+    if (known_game != game_state.get_game_id())
+        return known_events;
+
+    size_t mirrored = game_state.get_events().get_size();
+    return known_events > mirrored ? known_events - mirrored : 0;
+}
+
+void UpstreamLink::update_lag(const GameState &game_state, uint64_t now) {
+    if (get_events_behind(game_state) == 0)
+        behind_since_ns = 0;
+    else if (behind_since_ns == 0)
+        behind_since_ns = now;
+}
+
+void UpstreamLink::request(const GameState &game_state, uint64_t now) {
+    // First event of a new game is asked for once the game is known to have started.
+    bool current_game = known_game == game_state.get_game_id();
+    event_no_t next = current_game ? game_state.get_events().get_size() : 0;
+
+    // Only requests for events that surely exist are timed.
+    if (timed_since_ns == 0 && current_game && known_events > next) {
+        timed_game = known_game;
+        timed_event = next;
+        timed_since_ns = now;
+    }
+
+    char message[CLIENT_MESSAGE_HEADER_LENGTH];
+    uint64_t session = htobe64(session_id);
+    uint8_t turn_direction = STRAIGHT | WIDE_PLAYER_NUMBERS_FLAG;
+    uint32_t next_expected = htobe32(next);
+    memcpy(message, &session, sizeof(session));
+    memcpy(message + sizeof(session), &turn_direction, sizeof(turn_direction));
+    memcpy(message + sizeof(session) + sizeof(turn_direction), &next_expected,
+           sizeof(next_expected));
+
+    // Request that is lost or refused is repeated in the next round anyway.
+    ssize_t ignored = send(sock, message, sizeof(message), MSG_DONTWAIT);
+    (void)ignored;
+}
+
+size_t UpstreamLink::receive(GameState &game_state, uint64_t now, server_metrics_t &metrics) {
+    struct timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    uint64_t realtime_ns = realtime.tv_sec * 1000000000ULL + realtime.tv_nsec;
+
+    size_t mirrored = 0;
+    char data[DATAGRAM_SIZE];
+    union {
+        char buf[CMSG_SPACE(sizeof(struct timespec))];
+        struct cmsghdr align;
+    } control;
+    while (true) {
+        struct iovec iov{data, sizeof(data)};
+        struct msghdr msg{};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        ssize_t len = recvmsg(sock, &msg, MSG_DONTWAIT);
+        if (len < 0) {
+            // Refusal of an earlier request is reported once, when upstream is down.
+            if (errno == EINTR || errno == ECONNREFUSED)
+                continue;
+            break;
+        }
+
+        ++stats.datagrams;
+        stats.bytes += len;
+        size_t new_events = handle_datagram(game_state, data, len, now,
+                                            metrics.upstream_request_ns);
+        mirrored += new_events;
+
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (new_events > 0 && cmsg != nullptr && cmsg->cmsg_level == SOL_SOCKET &&
+            cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec arrival;
+            memcpy(&arrival, CMSG_DATA(cmsg), sizeof(arrival));
+            uint64_t arrival_ns = arrival.tv_sec * 1000000000ULL + arrival.tv_nsec;
+            uint64_t delay = realtime_ns > arrival_ns ? realtime_ns - arrival_ns : 0;
+            metrics.upstream_delay_ns.observe(delay);
+            max_delay_ns = std::max(max_delay_ns, delay);
+        }
+    }
+
+    update_lag(game_state, now);
+    return mirrored;
+}
+
+size_t UpstreamLink::handle_datagram(GameState &game_state, const char *data, size_t len,
+                                     uint64_t now, LatencyHistogram &request_latency) {
+    size_t mirrored = 0;
+    if (len < sizeof(game_id_t)) {
+        ++stats.malformed;
+        return mirrored;
+    }
+    game_id_t game_id = read_number(data);
+    size_t position = sizeof(game_id_t);
+
+    while (position < len) {
+        if (len - position < EVENT_OVERHEAD) {
+            ++stats.malformed;
+            return mirrored;
+        }
+        event_len_t event_len = read_number(data + position);
+        size_t total = sizeof(event_len_t) + event_len + sizeof(crc32_t);
+        if (event_len < sizeof(event_no_t) + sizeof(event_type_t) || len - position < total ||
+            compute_crc32(data + position, total - sizeof(crc32_t)) !=
+                read_number(data + position + total - sizeof(crc32_t))) {
+            ++stats.malformed;
+            return mirrored;
+        }
+
+        const char *event = data + position;
+        event_no_t event_no = read_number(event + sizeof(event_len_t));
+        uint8_t type = event[sizeof(event_len_t) + sizeof(event_no_t)];
+        position += total;
+
+        // Mirroring of a new game starts from its first event.
+        bool mirrored_game = game_state.get_games_started() > 0 &&
+            game_id == game_state.get_game_id();
+        if (!mirrored_game && game_id != previous_game && event_no == 0 &&
+            (type == NEW_GAME || type == WIDE_NEW_GAME)) {
+            previous_game = game_state.get_game_id();
+            game_state.mirror_game(game_id, type == WIDE_NEW_GAME);
+            mirrored_game = true;
+            timed_since_ns = 0;
+        }
+
+        if (!mirrored_game && game_id == previous_game) {
+            ++stats.stale_events;
+            continue;
+        }
+
+        // Late datagrams of the mirrored game do not hide a newer game that was seen.
+        if (game_id != known_game &&
+            (!mirrored_game || known_events == 0 || known_game == previous_game)) {
+            known_game = game_id;
+            known_events = 0;
+        }
+        if (game_id == known_game)
+            known_events = std::max<size_t>(known_events, size_t(event_no) + 1);
+
+        size_t expected = game_state.get_events().get_size();
+        if (!mirrored_game || event_no > expected) {
+            ++stats.early_events;
+            continue;
+        }
+        if (event_no < expected) {
+            ++stats.stale_events;
+            continue;
+        }
+
+        game_state.mirror_event(event, total);
+        ++stats.events;
+        ++mirrored;
+        if (timed_since_ns != 0 && timed_game == game_id && timed_event == event_no) {
+            request_latency.observe(now - timed_since_ns);
+            timed_since_ns = 0;
+        }
+    }
+
+    return mirrored;
+}
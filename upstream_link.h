@@ -0,0 +1,125 @@
+#ifndef SCREEN_WORMS_UPSTREAM_LINK_H
+#define SCREEN_WORMS_UPSTREAM_LINK_H
+
+#include <string>
+
+#include "game_state.h"
+#include "metrics.h"
+
+// Relay prints its lag behind upstream that often.
+#define RELAY_REPORT_INTERVAL_NS    10000000000ULL
+
+/*
+ * Statistics of datagrams received from upstream. Events are counted once mirrored;
+ * stale ones were mirrored already or belong to a game that is over, and early ones
+ * came after an event that is still missing and will be requested again.
+ */
+struct upstream_stats_t {
+    uint64_t datagrams;
+    uint64_t bytes;
+    uint64_t malformed;
+    uint64_t events;
+    uint64_t stale_events;
+    uint64_t early_events;
+};
+
+/*
+ * Connection of a relay to its upstream server, which may be a relay itself. The relay
+ * is a spectator of upstream: it asks for events after the ones it mirrored, with the
+ * wide flag set so that it is admitted to any game, and mirrors the events it gets into
+ * [GameState] in order.
+ *
+ * Lag behind upstream is measured in events known to exist upstream, as some later
+ * event was received, but not mirrored yet, and in time since the oldest of them was
+ * first known. Requests for events known to exist upstream are timed until the
+ * requested event arrives, and datagrams bringing new events are timed from their
+ * arrival at the socket, so that a relay that falls behind its upstream shows it even
+ * when no event is lost. Every relay of a chain reports its own lag.
+ */
+class UpstreamLink {
+public:
+    UpstreamLink();
+    ~UpstreamLink();
+
+    UpstreamLink(const UpstreamLink &) = delete;
+    UpstreamLink &operator=(const UpstreamLink &) = delete;
+
+    /*
+     * Connects to upstream at [address] given as host:port. Exits the program if
+     * the address cannot be resolved.
+     */
+    void connect(const std::string &address);
+
+    bool is_connected() const {
+        return sock >= 0;
+    }
+
+    int get_fd() const {
+        return sock;
+    }
+
+    /*
+     * Asks upstream for events of [game_state] that were not mirrored yet.
+     */
+    void request(const GameState &game_state, uint64_t now);
+
+    /*
+     * Receives all pending datagrams and mirrors their events into [game_state].
+     * Timed requests and delays of datagrams are recorded in [metrics]. Returns number
+     * of mirrored events.
+     */
+    size_t receive(GameState &game_state, uint64_t now, server_metrics_t &metrics);
+
+    /*
+     * Number of events known to exist upstream that were not mirrored yet.
+     */
+    size_t get_events_behind(const GameState &game_state) const;
+
+    /*
+     * Time since the oldest event that was not mirrored yet was first known to exist.
+     */
+    uint64_t get_lag_ns(uint64_t now) const {
+        return behind_since_ns == 0 ? 0 : now - behind_since_ns;
+    }
+
+    const upstream_stats_t &get_stats() const {
+        return stats;
+    }
+
+    /*
+     * Returns the longest delay between arrival and mirroring of a datagram since
+     * the previous call.
+     */
+    uint64_t take_max_delay_ns() {
+        uint64_t delay = max_delay_ns;
+        max_delay_ns = 0;
+        return delay;
+    }
+
+private:
+    /*
+     * Mirrors events of a single datagram. Returns number of mirrored events.
+     */
+    size_t handle_datagram(GameState &game_state, const char *data, size_t len, uint64_t now,
+                           LatencyHistogram &request_latency);
+
+    void update_lag(const GameState &game_state, uint64_t now);
+
+private:
+    int sock;
+    session_id_t session_id;
+    // Newest game known to be played upstream and number of its events known to exist.
+    game_id_t known_game;
+    size_t known_events;
+    // Game that was mirrored before the current one; its late datagrams are ignored.
+    game_id_t previous_game;
+    uint64_t behind_since_ns;
+    // Request being timed: first requested event of game [timed_game] and send time.
+    game_id_t timed_game;
+    event_no_t timed_event;
+    uint64_t timed_since_ns;
+    uint64_t max_delay_ns;
+    upstream_stats_t stats;
+};
+
+#endif //SCREEN_WORMS_UPSTREAM_LINK_H
@@ -0,0 +1,357 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring_loop.h"
+#include "err.h"
+
+namespace {
+    constexpr size_t RECV_BUFFER_SIZE = sizeof(struct io_uring_recvmsg_out) +
+            sizeof(struct sockaddr_in6) + DATAGRAM_SIZE;
+
+    uint64_t make_user_data(uring_op op, uint32_t slot) {
+        return (uint64_t(op) << 32) | slot;
+    }
+
+    unsigned int load_acquire(const unsigned int *p) {
+        return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+    }
+
+    void store_release(unsigned int *p, unsigned int value) {
+        __atomic_store_n(p, value, __ATOMIC_RELEASE);
+    }
+
+    // Send failed because of a full socket buffer and succeeds once it drains.
+    bool is_retryable(int error) {
+        return error == EAGAIN || error == EWOULDBLOCK || error == ENOBUFS || error == EINTR;
+    }
+}
+
+UringLoop::UringLoop() : ring_fd(-1), sock(-1), timer_fd(-1), sq_ptr(MAP_FAILED), sq_size(0),
+        cq_ptr(MAP_FAILED), cq_size(0), sqes(nullptr), sqes_size(0), sq_head(nullptr),
+        sq_tail(nullptr), sq_mask(0), sq_entries(0), sq_array(nullptr), cq_head(nullptr),
+        cq_tail(nullptr), cq_mask(0), cqes(nullptr), local_sq_tail(0), submitted_sq_tail(0),
+        buf_ring(nullptr), buf_ring_size(0), recv_msg{}, buf_ring_tail(0), timer_value(0),
+        receive_armed(false), timer_armed(false), writable_armed(false), enter_calls(0),
+        completions(0), send_stats{0, 0, 0} {}
+
+UringLoop::~UringLoop() {
+    teardown();
+}
+
+void UringLoop::teardown() {
+    if (buf_ring != nullptr)
+        munmap(buf_ring, buf_ring_size);
+    if (sqes != nullptr)
+        munmap(sqes, sqes_size);
+    if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+        munmap(cq_ptr, cq_size);
+    if (sq_ptr != MAP_FAILED)
+        munmap(sq_ptr, sq_size);
+    if (ring_fd != -1)
+        close(ring_fd);
+
+    buf_ring = nullptr;
+    sqes = nullptr;
+    cq_ptr = sq_ptr = MAP_FAILED;
+    ring_fd = -1;
+}
+
+bool UringLoop::fail_setup() {
+    int error = errno;
+    teardown();
+    errno = error;
+    return false;
+}
+
+bool UringLoop::setup(int socket_fd, int timer) {
+    sock = socket_fd;
+    timer_fd = timer;
+
+    struct io_uring_params p{};
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = 4 * URING_ENTRIES;
+    ring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &p);
+    if (ring_fd < 0) {
+        ring_fd = -1;
+        return false;
+    }
+
+    // Maps submission and completion rings.
+    sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap)
+        sq_size = cq_size = std::max(sq_size, cq_size);
+
+    sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                  ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ptr == MAP_FAILED)
+        return fail_setup();
+    cq_ptr = single_mmap ? sq_ptr : mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+    if (cq_ptr == MAP_FAILED)
+        return fail_setup();
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes_ptr = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED)
+        return fail_setup();
+    sqes = static_cast<struct io_uring_sqe *>(sqes_ptr);
+
+    char *sq = static_cast<char *>(sq_ptr);
+    sq_head = reinterpret_cast<unsigned int *>(sq + p.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned int *>(sq + p.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned int *>(sq + p.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned int *>(sq + p.sq_off.array);
+    sq_entries = p.sq_entries;
+    local_sq_tail = submitted_sq_tail = *sq_tail;
+
+    char *cq = static_cast<char *>(cq_ptr);
+    cq_head = reinterpret_cast<unsigned int *>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned int *>(cq + p.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned int *>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(cq + p.cq_off.cqes);
+
+    // Registers provided buffer ring used by multishot receive.
+    buf_ring_size = URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+    void *ring_mem = mmap(nullptr, buf_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    if (ring_mem == MAP_FAILED)
+        return fail_setup();
+    buf_ring = static_cast<struct io_uring_buf *>(ring_mem);
+    // Touches the ring, so the kernel pins its own page and not the shared zero page.
+    memset(buf_ring, 0, buf_ring_size);
+
+    struct io_uring_buf_reg reg{};
+    reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+    reg.ring_entries = URING_RECV_BUFFERS;
+    reg.bgid = URING_RECV_GROUP;
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0)
+        return fail_setup();
+
+    recv_buffers.resize(URING_RECV_BUFFERS * RECV_BUFFER_SIZE);
+    for (uint16_t i = 0; i < URING_RECV_BUFFERS; ++i)
+        add_recv_buffer(i);
+
+    recv_msg.msg_namelen = sizeof(struct sockaddr_in6);
+    return true;
+}
+
+void UringLoop::add_recv_buffer(uint16_t buffer_id) {
+    struct io_uring_buf &buf = buf_ring[buf_ring_tail & (URING_RECV_BUFFERS - 1)];
+    buf.addr = reinterpret_cast<uint64_t>(recv_buffers.data() + buffer_id * RECV_BUFFER_SIZE);
+    buf.len = RECV_BUFFER_SIZE;
+    buf.bid = buffer_id;
+    ++buf_ring_tail;
+    // Ring tail overlays [resv] field of the first entry.
+    __atomic_store_n(&buf_ring[0].resv, buf_ring_tail, __ATOMIC_RELEASE);
+}
+
+struct io_uring_sqe *UringLoop::get_sqe() {
+    // Submission queue is full, so queued requests are handed to the kernel first. The
+    // kernel may consume fewer of them or none, e.g. while its completion queue is full.
+    if (local_sq_tail - load_acquire(sq_head) >= sq_entries) {
+        enter(0);
+        if (local_sq_tail - load_acquire(sq_head) >= sq_entries)
+            return nullptr;
+    }
+
+    unsigned int index = local_sq_tail & sq_mask;
+    sq_array[index] = index;
+    ++local_sq_tail;
+
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void UringLoop::enter(unsigned int min_complete) {
+    store_release(sq_tail, local_sq_tail);
+    unsigned int to_submit = local_sq_tail - submitted_sq_tail;
+    unsigned int flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+
+    ++enter_calls;
+    int ret = syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+    if (ret < 0) {
+        if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+            return;
+        syserr("io_uring_enter");
+    }
+    submitted_sq_tail += ret;
+}
+
+void UringLoop::arm_receive() {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = sock;
+    sqe->addr = reinterpret_cast<uint64_t>(&recv_msg);
+    sqe->len = 1;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_RECV_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = make_user_data(URING_RECEIVE, 0);
+    receive_armed = true;
+}
+
+void UringLoop::arm_timer() {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = timer_fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&timer_value);
+    sqe->len = sizeof(timer_value);
+    sqe->user_data = make_user_data(URING_TIMER, 0);
+    timer_armed = true;
+}
+
+void UringLoop::arm_writable() {
+    struct io_uring_sqe *sqe = get_sqe();
+    if (sqe == nullptr)
+        return;
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = sock;
+    sqe->poll32_events = POLLOUT;
+    sqe->user_data = make_user_data(URING_WRITABLE, 0);
+    writable_armed = true;
+}
+
+void UringLoop::send_batch(SendBatch &batch) {
+    for (const auto &destination : batch.get_destinations()) {
+        uint32_t slot_index;
+        if (free_send_slots.empty()) {
+            slot_index = send_slots.size();
+            send_slots.emplace_back();
+        }
+        else {
+            slot_index = free_send_slots.back();
+            free_send_slots.pop_back();
+        }
+
+        // Slot must stay untouched until the kernel completes the request.
+        send_slot_t &slot = send_slots[slot_index];
+        slot.payload = batch.get_payload(destination.payload);
+        slot.address = destination.address;
+        slot.iov.iov_base = const_cast<char *>(slot.payload.get_data());
+        slot.iov.iov_len = slot.payload.get_length();
+        slot.msg = {};
+        slot.msg.msg_name = &slot.address;
+        slot.msg.msg_namelen = destination.address_len;
+        slot.msg.msg_iov = &slot.iov;
+        slot.msg.msg_iovlen = 1;
+        // Datagrams cannot overtake the ones still waiting for the submission queue.
+        pending_sends.push_back(slot_index);
+    }
+
+    batch.clear();
+    queue_pending_sends();
+}
+
+void UringLoop::queue_pending_sends() {
+    while (!pending_sends.empty()) {
+        struct io_uring_sqe *sqe = get_sqe();
+        if (sqe == nullptr)
+            return;
+
+        uint32_t slot_index = pending_sends.front();
+        pending_sends.pop_front();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sock;
+        sqe->addr = reinterpret_cast<uint64_t>(&send_slots[slot_index].msg);
+        sqe->len = 1;
+        sqe->user_data = make_user_data(URING_SEND, slot_index);
+    }
+}
+
+void UringLoop::submit_and_wait() {
+    // Receive and timer are re-armed first, so that pending sends cannot starve them.
+    if (!receive_armed)
+        arm_receive();
+    if (!timer_armed)
+        arm_timer();
+    if (!blocked_sends.empty() && !writable_armed)
+        arm_writable();
+    queue_pending_sends();
+
+    enter(1);
+}
+
+bool UringLoop::next_completion(uring_completion_t &completion) {
+    unsigned int head = *cq_head;
+    if (head == load_acquire(cq_tail))
+        return false;
+
+    struct io_uring_cqe cqe = cqes[head & cq_mask];
+    store_release(cq_head, head + 1);
+    ++completions;
+
+    completion = {};
+    completion.op = static_cast<uring_op>(cqe.user_data >> 32);
+    completion.result = cqe.res;
+
+    switch (completion.op) {
+        case URING_TIMER:
+            timer_armed = false;
+            break;
+        case URING_SEND: {
+            uint32_t slot_index = cqe.user_data & 0xFFFFFFFF;
+            if (cqe.res < 0) {
+                ++send_stats.failures;
+                // Slot keeps its payload until the send is retried.
+                if (is_retryable(-cqe.res)) {
+                    blocked_sends.push_back(slot_index);
+                    break;
+                }
+            }
+            else {
+                ++send_stats.datagrams;
+                send_stats.bytes += cqe.res;
+            }
+            send_slots[slot_index].payload.reset();
+            free_send_slots.push_back(slot_index);
+            break;
+        }
+        case URING_WRITABLE:
+            writable_armed = false;
+            // Blocked sends go before the ones that did not reach the kernel yet.
+            pending_sends.insert(pending_sends.begin(), blocked_sends.begin(),
+                                 blocked_sends.end());
+            blocked_sends.clear();
+            break;
+        case URING_RECEIVE:
+            // Multishot receive terminated, e.g. because buffers ran out.
+            if (!(cqe.flags & IORING_CQE_F_MORE))
+                receive_armed = false;
+
+            if (cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+                completion.buffer_id = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+                char *buf = recv_buffers.data() + completion.buffer_id * RECV_BUFFER_SIZE;
+                auto *out = reinterpret_cast<struct io_uring_recvmsg_out *>(buf);
+                size_t payload_offset = sizeof(*out) + recv_msg.msg_namelen +
+                        recv_msg.msg_controllen;
+
+                completion.address = reinterpret_cast<struct sockaddr_in6 *>(buf + sizeof(*out));
+                completion.address_len = out->namelen;
+                completion.payload = buf + payload_offset;
+                completion.payload_len = std::min<size_t>(out->payloadlen, DATAGRAM_SIZE);
+            }
+            else if (cqe.flags & IORING_CQE_F_BUFFER) {
+                add_recv_buffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            break;
+    }
+
+    return true;
+}
+
+void UringLoop::recycle(const uring_completion_t &completion) {
+    if (completion.op == URING_RECEIVE && completion.payload != nullptr)
+        add_recv_buffer(completion.buffer_id);
+}
@@ -0,0 +1,182 @@
+#ifndef SCREEN_WORMS_URING_LOOP_H
+#define SCREEN_WORMS_URING_LOOP_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "buffer.h"
+#include "send_batch.h"
+
+#define URING_ENTRIES           1024
+#define URING_RECV_BUFFERS      256
+#define URING_RECV_GROUP        0
+
+enum uring_op {
+    URING_TIMER = 0,
+    URING_RECEIVE,
+    URING_SEND,
+    // Socket became writable after sends failed on a full socket buffer.
+    URING_WRITABLE
+};
+
+struct uring_completion_t {
+    uring_op op;
+    int result;
+    // Set for received datagrams only.
+    const char *payload;
+    size_t payload_len;
+    const struct sockaddr_in6 *address;
+    socklen_t address_len;
+    uint16_t buffer_id;
+};
+
+/*
+ * Event loop backend built directly on io_uring system calls. Keeps a multishot
+ * receive with provided buffer ring posted on the socket and a read posted on the
+ * round timer; outbound datagrams are queued as sendmsg requests and submitted
+ * together with the next wait. Requests that do not fit in a full submission queue
+ * wait in the loop until the kernel consumes earlier ones. Sends that fail on a full
+ * socket buffer are kept and retried once the socket becomes writable, as the poll
+ * loop keeps them in its queue of waiting messages.
+ */
+class UringLoop {
+public:
+    UringLoop();
+    ~UringLoop();
+
+    UringLoop(const UringLoop &) = delete;
+    UringLoop &operator=(const UringLoop &) = delete;
+
+    /*
+     * Creates the ring and registers receive buffers.
+     * Returns [false] with [errno] set if the kernel does not support required features
+     * or a resource runs out; a partially created ring is released before that.
+     */
+    bool setup(int sock, int timer_fd);
+
+    /*
+     * Queues sendmsg requests for all datagrams scheduled in [batch] and empties it.
+     * Payloads stay referenced until the kernel completes their sends.
+     */
+    void send_batch(SendBatch &batch);
+
+    /*
+     * Re-arms receive and timer requests if needed, submits all queued requests
+     * and waits for at least one completion in a single io_uring_enter call.
+     */
+    void submit_and_wait();
+
+    /*
+     * Takes next completion from completion queue.
+     * Returns [false] if there are no more completions.
+     */
+    bool next_completion(uring_completion_t &completion);
+
+    /*
+     * Gives buffer of received datagram back to the kernel.
+     */
+    void recycle(const uring_completion_t &completion);
+
+    uint64_t get_enter_calls() const {
+        return enter_calls;
+    }
+
+    uint64_t get_completions() const {
+        return completions;
+    }
+
+    /*
+     * Statistics of completed sendmsg requests.
+     */
+    const send_stats_t &get_send_stats() const {
+        return send_stats;
+    }
+
+private:
+    struct send_slot_t {
+        PayloadRef payload;
+        struct sockaddr_in6 address;
+        struct iovec iov;
+        struct msghdr msg;
+    };
+
+    /*
+     * Returns free submission queue entry, handing queued requests to the kernel first
+     * if the queue is full. Returns [nullptr] if the kernel did not consume any.
+     */
+    struct io_uring_sqe *get_sqe();
+
+    /*
+     * Queues sendmsg requests of pending send slots while the submission queue has room.
+     */
+    void queue_pending_sends();
+
+    void enter(unsigned int min_complete);
+    void arm_receive();
+    void arm_timer();
+    void arm_writable();
+    void add_recv_buffer(uint16_t buffer_id);
+
+    /*
+     * Unmaps rings and closes the ring descriptor, whichever were created.
+     */
+    void teardown();
+
+    /*
+     * Tears down a partially set up ring keeping [errno]. Returns [false].
+     */
+    bool fail_setup();
+
+private:
+    int ring_fd;
+    int sock;
+    int timer_fd;
+
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int *sq_array;
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned int local_sq_tail;
+    unsigned int submitted_sq_tail;
+
+    // Entries of provided buffer ring. The C++ layout of [io_uring_buf_ring] differs
+    // from the kernel's one, so the ring is accessed as a plain array.
+    struct io_uring_buf *buf_ring;
+    size_t buf_ring_size;
+    std::vector<char> recv_buffers;
+    struct msghdr recv_msg;
+    uint16_t buf_ring_tail;
+
+    uint64_t timer_value;
+    bool receive_armed;
+    bool timer_armed;
+    bool writable_armed;
+
+    std::deque<send_slot_t> send_slots;
+    std::vector<uint32_t> free_send_slots;
+    // Filled send slots waiting for room in the submission queue, in sending order.
+    std::deque<uint32_t> pending_sends;
+    // Send slots whose sends failed on a full socket buffer, waiting for [URING_WRITABLE].
+    std::vector<uint32_t> blocked_sends;
+
+    uint64_t enter_calls;
+    uint64_t completions;
+    send_stats_t send_stats;
+};
+
+#endif //SCREEN_WORMS_URING_LOOP_H
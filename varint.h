@@ -0,0 +1,40 @@
+#ifndef SCREEN_WORMS_VARINT_H
+#define SCREEN_WORMS_VARINT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Unsigned LEB128 of a 32-bit number takes at most that many bytes.
+#define MAX_VARINT_LENGTH   5
+
+/*
+ * Writes [n] as unsigned LEB128 to [out]. Returns number of written bytes.
+ */
+inline size_t put_varint(char *out, uint32_t n) {
+    size_t len = 0;
+    while (n >= 0x80) {
+        out[len++] = char(n | 0x80);
+        n >>= 7;
+    }
+    out[len++] = char(n);
+    return len;
+}
+
+/*
+ * Reads varint at [position] of [data] ending at [end] into [n] and moves
+ * [position] after it. Returns [false] if it is truncated or too large.
+ */
+inline bool get_varint(const char *data, size_t end, size_t &position, uint32_t &n) {
+    n = 0;
+    for (size_t i = 0; i < MAX_VARINT_LENGTH && position < end; ++i) {
+        uint8_t byte = data[position++];
+        if (i == MAX_VARINT_LENGTH - 1 && byte > 0x0F)
+            return false;
+        n |= uint32_t(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+
+#endif //SCREEN_WORMS_VARINT_H
@@ -0,0 +1,143 @@
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "worms.h"
+#include "direction_table.h"
+
+namespace {
+    void step_worm(worms_t &worms, size_t i, uint32_t right_turn, uint32_t left_turn) {
+        if (worms.turn_direction[i] == RIGHT)
+            worms.direction[i] += right_turn;
+        else if (worms.turn_direction[i] == LEFT)
+            worms.direction[i] += left_turn;
+        worms.direction[i] %= 360;
+
+        worms.x[i] += DIRECTION_DX[worms.direction[i]];
+        worms.y[i] += DIRECTION_DY[worms.direction[i]];
+
+        pixel_t pixel = get_pixel(worms.x[i], worms.y[i]);
+        worms.moved[i] = pixel.first != worms.pixel_x[i] || pixel.second != worms.pixel_y[i];
+        worms.pixel_x[i] = pixel.first;
+        worms.pixel_y[i] = pixel.second;
+    }
+
+#ifdef __SSE2__
+    /*
+     * Rounds two doubles down to 32-bit integers in the lower half of the result.
+     * Coordinates of worms on the board are far from the limits of int32_t.
+     */
+    __m128i floor_pd(__m128d value) {
+        __m128i truncated = _mm_cvttpd_epi32(value);
+        __m128d back = _mm_cvtepi32_pd(truncated);
+        // Negative non-integers were rounded up, so 1 is subtracted from them.
+        __m128i rounded_up = _mm_castpd_si128(_mm_cmpgt_pd(back, value));
+        return _mm_add_epi32(truncated, _mm_shuffle_epi32(rounded_up, _MM_SHUFFLE(3, 3, 2, 0)));
+    }
+
+    /*
+     * Steps worms [i] to [i + 3].
+     */
+    void step_four_worms(worms_t &worms, size_t i, uint32_t right_turn, uint32_t left_turn) {
+        const __m128i zero = _mm_setzero_si128();
+
+        // Expands turn directions to 32-bit lanes.
+        int32_t turns;
+        memcpy(&turns, &worms.turn_direction[i], sizeof(turns));
+        __m128i turn = _mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(turns), zero), zero);
+
+        __m128i delta = _mm_or_si128(
+                _mm_and_si128(_mm_cmpeq_epi32(turn, _mm_set1_epi32(RIGHT)), _mm_set1_epi32(right_turn)),
+                _mm_and_si128(_mm_cmpeq_epi32(turn, _mm_set1_epi32(LEFT)), _mm_set1_epi32(left_turn)));
+        __m128i direction = _mm_add_epi32(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(&worms.direction[i])), delta);
+        // Direction is below 720, so a single subtraction computes it modulo 360.
+        __m128i full_circle = _mm_cmpgt_epi32(direction, _mm_set1_epi32(359));
+        direction = _mm_sub_epi32(direction, _mm_and_si128(full_circle, _mm_set1_epi32(360)));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&worms.direction[i]), direction);
+
+        uint32_t d[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(d), direction);
+
+        __m128d x01 = _mm_add_pd(_mm_loadu_pd(&worms.x[i]),
+                                 _mm_set_pd(DIRECTION_DX[d[1]], DIRECTION_DX[d[0]]));
+        __m128d x23 = _mm_add_pd(_mm_loadu_pd(&worms.x[i + 2]),
+                                 _mm_set_pd(DIRECTION_DX[d[3]], DIRECTION_DX[d[2]]));
+        __m128d y01 = _mm_add_pd(_mm_loadu_pd(&worms.y[i]),
+                                 _mm_set_pd(DIRECTION_DY[d[1]], DIRECTION_DY[d[0]]));
+        __m128d y23 = _mm_add_pd(_mm_loadu_pd(&worms.y[i + 2]),
+                                 _mm_set_pd(DIRECTION_DY[d[3]], DIRECTION_DY[d[2]]));
+        _mm_storeu_pd(&worms.x[i], x01);
+        _mm_storeu_pd(&worms.x[i + 2], x23);
+        _mm_storeu_pd(&worms.y[i], y01);
+        _mm_storeu_pd(&worms.y[i + 2], y23);
+
+        __m128i pixel_x = _mm_unpacklo_epi64(floor_pd(x01), floor_pd(x23));
+        __m128i pixel_y = _mm_unpacklo_epi64(floor_pd(y01), floor_pd(y23));
+        auto *old_x = reinterpret_cast<__m128i *>(&worms.pixel_x[i]);
+        auto *old_y = reinterpret_cast<__m128i *>(&worms.pixel_y[i]);
+        __m128i same = _mm_and_si128(_mm_cmpeq_epi32(pixel_x, _mm_loadu_si128(old_x)),
+                                     _mm_cmpeq_epi32(pixel_y, _mm_loadu_si128(old_y)));
+        _mm_storeu_si128(old_x, pixel_x);
+        _mm_storeu_si128(old_y, pixel_y);
+
+        int same_mask = _mm_movemask_ps(_mm_castsi128_ps(same));
+        for (int k = 0; k < 4; ++k)
+            worms.moved[i + k] = !(same_mask & (1 << k));
+    }
+#endif
+}
+
+void worms_t::add(const worm_position_t &position, turn_direction_t turn,
+                  player_number_t player_number, slot_t player_slot) {
+    pixel_t pixel = get_pixel(position.x, position.y);
+
+    x.push_back(position.x);
+    y.push_back(position.y);
+    direction.push_back(position.direction);
+    turn_direction.push_back(turn);
+    pixel_x.push_back(pixel.first);
+    pixel_y.push_back(pixel.second);
+    moved.push_back(false);
+    number.push_back(player_number);
+    slot.push_back(player_slot);
+}
+
+void worms_t::copy(size_t from, size_t to) {
+    x[to] = x[from];
+    y[to] = y[from];
+    direction[to] = direction[from];
+    turn_direction[to] = turn_direction[from];
+    pixel_x[to] = pixel_x[from];
+    pixel_y[to] = pixel_y[from];
+    moved[to] = moved[from];
+    number[to] = number[from];
+    slot[to] = slot[from];
+}
+
+void worms_t::resize(size_t count) {
+    x.resize(count);
+    y.resize(count);
+    direction.resize(count);
+    turn_direction.resize(count);
+    pixel_x.resize(count);
+    pixel_y.resize(count);
+    moved.resize(count);
+    number.resize(count);
+    slot.resize(count);
+}
+
+void step_worms(worms_t &worms, uint32_t turning_speed) {
+    // Turning left by [turning_speed] is turning right by its complement.
+    uint32_t right_turn = turning_speed;
+    uint32_t left_turn = 360 - turning_speed;
+
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= worms.size(); i += 4)
+        step_four_worms(worms, i, right_turn, left_turn);
+#endif
+    for (; i < worms.size(); ++i)
+        step_worm(worms, i, right_turn, left_turn);
+}
@@ -0,0 +1,60 @@
+#ifndef SCREEN_WORMS_WORMS_H
+#define SCREEN_WORMS_WORMS_H
+
+#include <cmath>
+#include <vector>
+
+#include "server_types.h"
+
+/*
+ * Worms still on the board, in alphabetical order of their players' names, kept as
+ * structure of arrays for the round loop. Worm of a disconnected player keeps moving
+ * with its last turn direction and has [NO_SLOT] as slot.
+ */
+struct worms_t {
+    std::vector<double> x;
+    std::vector<double> y;
+    std::vector<uint32_t> direction;
+    std::vector<turn_direction_t> turn_direction;
+    // Pixel the worm is in.
+    std::vector<coordinate_t> pixel_x;
+    std::vector<coordinate_t> pixel_y;
+    // Set by [step_worms] for worms that entered a new pixel.
+    std::vector<uint8_t> moved;
+    std::vector<player_number_t> number;
+    std::vector<slot_t> slot;
+
+    size_t size() const {
+        return slot.size();
+    }
+
+    void add(const worm_position_t &position, turn_direction_t turn, player_number_t player_number,
+             slot_t player_slot);
+
+    /*
+     * Overwrites worm [to] with worm [from].
+     */
+    void copy(size_t from, size_t to);
+
+    void resize(size_t count);
+
+    void clear() {
+        resize(0);
+    }
+};
+
+/*
+ * Converts position to pixel coordinates, rounding down. Negative coordinates wrap
+ * around to values that are off every board.
+ */
+inline pixel_t get_pixel(double x, double y) {
+    return {coordinate_t(int64_t(floor(x))), coordinate_t(int64_t(floor(y)))};
+}
+
+/*
+ * Turns all worms by their turn directions, moves them by 1 and marks worms that
+ * entered a new pixel. Runs on SSE2 where available.
+ */
+void step_worms(worms_t &worms, uint32_t turning_speed);
+
+#endif //SCREEN_WORMS_WORMS_H
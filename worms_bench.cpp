@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#include "worms.h"
+
+/*
+ * Compares [step_worms] with stepping every worm with cos and sin, as the game did
+ * before the direction table. Prints nanoseconds per worm step for growing worm counts.
+ */
+namespace {
+    constexpr size_t TOTAL_STEPS = 1 << 24;
+    constexpr uint32_t TURNING_SPEED = 6;
+
+    void fill(worms_t &worms, size_t count) {
+        worms.clear();
+        for (size_t i = 0; i < count; ++i) {
+            worm_position_t position{double(i % 1000) + 1000.5, double(i / 1000) + 1000.5,
+                                     uint32_t(i * 37 % 360)};
+            worms.add(position, turn_direction_t(i % 3), 0, i);
+        }
+    }
+
+    void step_with_libm(worms_t &worms, uint32_t turning_speed) {
+        for (size_t i = 0; i < worms.size(); ++i) {
+            if (worms.turn_direction[i] == RIGHT)
+                worms.direction[i] += turning_speed;
+            else if (worms.turn_direction[i] == LEFT)
+                worms.direction[i] -= (-360 + turning_speed);
+            worms.direction[i] = worms.direction[i] % 360;
+
+            double direction = worms.direction[i];
+            worms.x[i] += cos(direction * M_PI / 180.0);
+            worms.y[i] += sin(direction * M_PI / 180.0);
+
+            pixel_t pixel = get_pixel(worms.x[i], worms.y[i]);
+            worms.moved[i] = pixel.first != worms.pixel_x[i] || pixel.second != worms.pixel_y[i];
+            worms.pixel_x[i] = pixel.first;
+            worms.pixel_y[i] = pixel.second;
+        }
+    }
+
+    template<typename Step>
+    double measure(size_t count, Step step) {
+        worms_t worms;
+        fill(worms, count);
+        size_t rounds = TOTAL_STEPS / count;
+
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < rounds; ++r)
+            step(worms, TURNING_SPEED);
+        auto end = std::chrono::steady_clock::now();
+
+        // Keeps the compiler from dropping the loop.
+        volatile double sink = worms.x[count - 1];
+        (void) sink;
+
+        return std::chrono::duration<double, std::nano>(end - start).count() / (rounds * count);
+    }
+}
+
+int main() {
+    printf("worms,libm_ns_per_step,kernel_ns_per_step,speedup\n");
+    for (size_t count = 4; count <= 65536; count *= 4) {
+        double libm = measure(count, step_with_libm);
+        double kernel = measure(count, step_worms);
+        printf("%zu,%.2f,%.2f,%.2f\n", count, libm, kernel, libm / kernel);
+    }
+
+    return 0;
+}